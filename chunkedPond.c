@@ -0,0 +1,1062 @@
+/* Sparse version of nanopond for ponds far too large for a dense cellArray.
+ *
+ * The pond is cut into CHUNK_SIDE x CHUNK_SIDE chunks, and a chunk only
+ * exists in memory once energy flows into it, either from inflow or from a
+ * SHARE across its edge. A chunk in which every cell has stayed dead for
+ * chunkReleaseAge ticks is freed again. An absent chunk reads as cells with
+ * no energy, parent 0 and a genome of all STOPs (emptyCell), so picking a
+ * cell there, KILLing into it or scanning it never touches its memory.
+ *
+ * A freed chunk loses the genomes of its dead cells. In a dense pond those
+ * could come back to life if a neighbor shared energy with them; here they
+ * come back blank.
+ *
+ * A per-cell Mersenne Twister is 2.5 KB per cell, which does not scale to a
+ * 100k x 100k pond, so cells draw from their executing thread's generator
+ * instead. Runs are therefore only repeatable with one thread.
+ *
+ * Define OUT_OF_CORE (make chunked-ooc) for ponds bigger than RAM. Chunks
+ * then live at fixed offsets in a sparse memory-mapped backing file instead
+ * of on the heap, and an LRU of at most hotChunkLimit chunks is kept resident.
+ * Picks are drawn a batch ahead so the chunks they land in can be hinted with
+ * MADV_WILLNEED while the current batch runs, and chunks falling off the LRU
+ * are hinted back out. Stats scans read a cold chunk once and then reuse its
+ * summary until it is warmed again.
+ *
+ * Usage: chunked [-x width] [-y height] [-b batch] [-r release age]
+ *        chunked-ooc ... [-f backing file] [-c hot chunks]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <stdatomic.h>
+#include <omp.h>
+#ifdef OUT_OF_CORE
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+// pond constants
+#define STOP_AT 3000000
+#define UPDATE_FREQUENCY 100000
+#define REPORT_FREQUENCY 10000000
+#define CLOCKUPDATE_FREQUENCY 10000
+#define MUTATION_RATE 21475
+#define INFLOW_FREQUENCY 100
+#define INFLOW_RATE_BASE 4000
+#define INFLOW_RATE_VARIATION 8000
+#define POND_SIZE_X 640
+#define POND_SIZE_Y 480
+#define MAX_NUM_INSTR 512
+#define FAILED_KILL_PENALTY 2
+
+#define BATCH_SIZE 100
+
+// chunk edge in cells
+#define CHUNK_SIDE 64
+#define CHUNK_CELLS (CHUNK_SIDE * CHUNK_SIDE)
+
+// ticks a chunk must stay fully dead before it is freed; checked every
+// CLOCKUPDATE_FREQUENCY ticks
+#define CHUNK_RELEASE_AGE 100000
+
+// Define OUT_OF_CORE (make chunked-ooc) to keep chunks in a memory-mapped
+// backing file with an LRU of HOT_CHUNKS resident chunks
+//#define OUT_OF_CORE 1
+#define BACKING_FILE "pond.chunks"
+#define HOT_CHUNKS 1024
+
+#define MAX_WORDS_GENOME (MAX_NUM_INSTR / (sizeof(uintptr_t) * 2))
+#define BITS_IN_WORD (sizeof(uintptr_t) * 8)
+#define N_LEFT 0
+#define N_RIGHT 1
+#define N_UP 2
+#define N_DOWN 3
+#define EXEC_START_WORD 0
+#define EXEC_START_BIT 4
+
+// Run parameters, set from the command line in main()
+static uint64_t pondSizeX = POND_SIZE_X;
+static uint64_t pondSizeY = POND_SIZE_Y;
+static uintptr_t batchSize = BATCH_SIZE;
+static uintptr_t chunkReleaseAge = CHUNK_RELEASE_AGE;
+static uint64_t chunksX, chunksY;
+
+// RNG variables; indexes and arrays
+// RNG functions
+#define N 624
+#define M 397
+#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
+#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
+#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
+
+/* One generator per thread, then the picker/inflow generator */
+static unsigned long (*rngArray)[N];
+static int *rngIndexArray;
+static int pickerRNG;
+
+static void init_genrand(int whichRNG, unsigned long s)
+{
+	int j;
+	rngArray[whichRNG][0] = s & 0xffffffffUL;
+	for (j = 1; j < N; j++) {
+		rngArray[whichRNG][j] = (1812433253UL * (rngArray[whichRNG][j-1] ^ (rngArray[whichRNG][j-1] >> 30)) + j);
+		rngArray[whichRNG][j] &= 0xffffffffUL;
+	}
+	rngIndexArray[whichRNG] = N;
+}
+
+static inline uint32_t genrand_int32Array(int whichRNG) {
+	uint32_t y;
+	static const uint32_t mag01[2]={0x0UL, MATRIX_A};
+	unsigned long *mt = rngArray[whichRNG];
+
+	if (rngIndexArray[whichRNG] >= N) { /* generate N words at one time */
+		int kk;
+		for (kk=0;kk<N-M;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		for (;kk<N-1;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
+		mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+
+		rngIndexArray[whichRNG] = 0;
+	}
+
+	y = mt[rngIndexArray[whichRNG]++];
+
+	/* Tempering */
+	y ^= (y >> 11);
+	y ^= (y << 7) & 0x9d2c5680UL;
+	y ^= (y << 15) & 0xefc60000UL;
+	y ^= (y >> 18);
+
+	return y;
+}
+
+static inline uintptr_t getRandomFromArray(int whichRNG)
+{
+	if (sizeof(uintptr_t) == 8)
+		return (uintptr_t)((((uint64_t)genrand_int32Array(whichRNG)) << 32) ^ ((uint64_t)genrand_int32Array(whichRNG)));
+	return (uintptr_t)genrand_int32Array(whichRNG);
+}
+
+//central structures
+static const uintptr_t BITS_IN_FOURBIT_WORD[16] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
+
+struct Cell {
+	uint64_t ID;            /* Globally unique cell ID */
+	uint64_t parentID;      /* ID of the cell's parent */
+	uint64_t lineage;       /* Equal to the cell ID of the first cell in the line. */
+	uintptr_t generation;       /* Generations start at 0 and are incremented from there. */
+	uintptr_t energy;       /* Energy level of this cell */
+	uintptr_t genome[MAX_WORDS_GENOME];/* four-bit instructions packed into machine-size words, stored complemented */
+};
+
+/* Genome words are kept complemented, so zeroed memory reads as all STOPs and
+ * a chunk needs no initialization pass; the kernel only ever sees ~genome. */
+#define GENOME_WORD(c,i) (~(c)->genome[(i)])
+#define SET_GENOME_WORD(c,i,v) ((c)->genome[(i)] = ~(v))
+
+/* Per-chunk totals gathered by the stats scan */
+struct ChunkSummary {
+	uint64_t active;
+	uint64_t energy;
+	uint64_t viable;
+	uintptr_t maxGeneration;
+};
+
+struct Chunk {
+	struct Cell cells[CHUNK_CELLS];/* Column by column, like cellArray */
+};
+
+/* Chunk directory, chunksX * chunksY entries; NULL for absent chunks */
+static _Atomic(struct Chunk *) *chunkTable;
+
+/* Clock at which each chunk was first seen fully dead, 0 while alive. Kept
+ * beside the chunks so the release check does not have to touch them. */
+static uintptr_t *chunkDeadSince;
+static atomic_uintptr_t residentChunks;
+
+#ifdef OUT_OF_CORE
+/* Chunk ci lives at chunkBase + ci * chunkStride in the backing file */
+static uint8_t *chunkBase;
+static uintptr_t chunkStride;
+static const char *backingPath = BACKING_FILE;
+
+/* LRU of resident chunks, most recent first. Entry chunksX * chunksY is the
+ * list head. Only the master thread touches it, between batches. */
+static uint64_t hotChunkLimit = HOT_CHUNKS;
+static uint64_t hotChunks;
+static uint64_t *lruPrev, *lruNext;
+
+/* A chunk is HOT while on the LRU, COLD once the stats scan has read it
+ * after it left the LRU (coldSummary then holds its stats), and STALE in
+ * between or before it is ever warmed */
+#define CHUNK_STALE 0
+#define CHUNK_HOT 1
+#define CHUNK_COLD 2
+static uint8_t *chunkState;
+static struct ChunkSummary *coldSummary;
+
+/* Evicted chunks are only marked as reclaimable; the kernel writes them back
+ * when it actually needs the memory */
+#ifdef MADV_COLD
+#define COLD_ADVICE MADV_COLD
+#else
+#define COLD_ADVICE MADV_DONTNEED
+#endif
+#endif
+
+/* What every cell of an absent chunk looks like: all zero, which thanks to
+ * the complemented genome is a blank cell. Never written. */
+static struct Cell emptyCell;
+
+struct PerUpdateStatCounters
+{
+	double instructionExecutions[16];/* Per-instruction-type execution count since last update. */
+	double cellExecutions;      /* Number of cells executed since last update */
+	uintptr_t viableCellsReplaced;  /* Number of viable cells replaced by other cells' offspring */
+	uintptr_t viableCellsKilled;    /* Number of viable cells KILLed */
+	uintptr_t viableCellShares; /* Number of successful SHARE operations */
+};
+
+struct PerUpdateStatCounters statCounters;
+
+static inline uint64_t chunkIndex(const uint64_t x,const uint64_t y)
+{
+	return (x / CHUNK_SIDE) * chunksY + (y / CHUNK_SIDE);
+}
+
+static inline uintptr_t cellInChunk(const uint64_t x,const uint64_t y)
+{
+	return (x % CHUNK_SIDE) * CHUNK_SIDE + (y % CHUNK_SIDE);
+}
+
+static void summarizeChunk(const struct Chunk *const ch,struct ChunkSummary *const sum)
+{
+	uintptr_t i;
+	memset(sum,0,sizeof(*sum));
+	for(i=0;i<CHUNK_CELLS;++i) {
+		const struct Cell *const c = &ch->cells[i];
+		if (c->energy) {
+			++sum->active;
+			sum->energy += (uint64_t)c->energy;
+			if (c->generation > 2)
+				++sum->viable;
+			if (c->generation > sum->maxGeneration)
+				sum->maxGeneration = c->generation;
+		}
+	}
+}
+
+/**
+ * Cell at (x,y) for reading, or emptyCell if its chunk is absent
+ */
+static inline struct Cell *peekCell(const uint64_t x,const uint64_t y)
+{
+	struct Chunk *const ch = atomic_load_explicit(&chunkTable[chunkIndex(x,y)],memory_order_acquire);
+	return (ch) ? &ch->cells[cellInChunk(x,y)] : &emptyCell;
+}
+
+/**
+ * Cell at (x,y) for writing, allocating its chunk first if it is absent.
+ * A chunk is big enough that calloc() maps it fresh from the kernel, so only
+ * the pages actually written become resident. Two threads may race to
+ * allocate the same chunk; the loser frees its copy.
+ */
+static struct Cell *touchCell(const uint64_t x,const uint64_t y)
+{
+	const uint64_t ci = chunkIndex(x,y);
+	_Atomic(struct Chunk *) *const slot = &chunkTable[ci];
+	struct Chunk *ch = atomic_load_explicit(slot,memory_order_acquire);
+	struct Chunk *expected = NULL;
+
+#ifdef OUT_OF_CORE
+	/* The chunk's place in the file already reads as blank cells */
+	if (!ch) {
+		ch = (struct Chunk *)(chunkBase + ci * chunkStride);
+		if (atomic_compare_exchange_strong(slot,&expected,ch))
+			atomic_fetch_add(&residentChunks,1);
+	}
+#else
+	if (!ch) {
+		ch = calloc(1,sizeof(struct Chunk));
+		if (!ch) {
+			fprintf(stderr,"[ERROR] Out of memory allocating a chunk (%lu resident).\n",
+				(uint64_t)atomic_load(&residentChunks));
+			exit(1);
+		}
+		if (atomic_compare_exchange_strong(slot,&expected,ch)) {
+			atomic_fetch_add(&residentChunks,1);
+		} else {
+			free(ch);
+			ch = expected;
+		}
+	}
+#endif
+	chunkDeadSince[ci] = 0;
+	return &ch->cells[cellInChunk(x,y)];
+}
+
+/**
+ * Records a write to the cell at (x,y) that did not go through touchCell():
+ * a cell executing, or writing into its neighbor through peekCell(). Under
+ * OUT_OF_CORE that cell's chunk may be cold, and its cached summary no
+ * longer holds, so it goes back to STALE to be read again by the next stats
+ * scan. Concurrent writers only ever store CHUNK_STALE here.
+ */
+static inline void wroteCell(const uint64_t x,const uint64_t y)
+{
+#ifdef OUT_OF_CORE
+	uint8_t *const state = &chunkState[chunkIndex(x,y)];
+	if (*state == CHUNK_COLD)
+		*state = CHUNK_STALE;
+#endif
+}
+
+/**
+ * Toroidal neighbor coordinates of (x,y)
+ */
+static inline void getNeighbor(const uint64_t x,const uint64_t y,const uintptr_t dir,uint64_t *nx,uint64_t *ny)
+{
+	*nx = x;
+	*ny = y;
+	switch(dir) {
+		case N_LEFT: 	*nx = (x) ? x-1 : pondSizeX-1; break;
+		case N_RIGHT: 	*nx = (x < (pondSizeX-1)) ? x+1 : 0; break;
+		case N_UP: 	*ny = (y) ? y-1 : pondSizeY-1; break;
+		case N_DOWN: 	*ny = (y < (pondSizeY-1)) ? y+1 : 0; break;
+	}
+}
+
+#ifdef OUT_OF_CORE
+static inline void lruUnlink(const uint64_t ci)
+{
+	lruNext[lruPrev[ci]] = lruNext[ci];
+	lruPrev[lruNext[ci]] = lruPrev[ci];
+}
+
+static inline void lruPushFront(const uint64_t ci)
+{
+	const uint64_t head = chunksX * chunksY;
+	lruPrev[ci] = head;
+	lruNext[ci] = lruNext[head];
+	lruPrev[lruNext[head]] = ci;
+	lruNext[head] = ci;
+}
+
+static inline void adviseChunk(const uint64_t ci,const int advice)
+{
+	madvise(chunkBase + ci * chunkStride,chunkStride,advice);
+}
+
+/**
+ * Marks chunk ci as about to be used. A chunk that was cold is asked to be
+ * read in, and the least recently used chunk beyond hotChunkLimit is marked
+ * reclaimable.
+ */
+static void warmChunk(const uint64_t ci)
+{
+	const uint64_t head = chunksX * chunksY;
+	uint64_t victim;
+
+	if (chunkState[ci] == CHUNK_HOT) {
+		lruUnlink(ci);
+		lruPushFront(ci);
+		return;
+	}
+	chunkState[ci] = CHUNK_HOT;
+	lruPushFront(ci);
+	adviseChunk(ci,MADV_WILLNEED);
+
+	if (++hotChunks > hotChunkLimit) {
+		victim = lruPrev[head];
+		lruUnlink(victim);
+		chunkState[victim] = CHUNK_STALE;
+		adviseChunk(victim,COLD_ADVICE);
+		--hotChunks;
+	}
+}
+
+/**
+ * Warms the resident chunks that the given picks land in; absent chunks
+ * have nothing to read in
+ */
+static void warmBatch(const uint64_t *locX,const uint64_t *locY)
+{
+	uintptr_t i;
+	uint64_t ci;
+	for (i = 0; i < batchSize; i++) {
+		ci = chunkIndex(locX[i],locY[i]);
+		if (atomic_load_explicit(&chunkTable[ci],memory_order_relaxed))
+			warmChunk(ci);
+	}
+}
+
+/**
+ * Creates, sizes and maps the backing file. The file is scratch space and is
+ * unlinked once mapped; only the chunks ever written take up disk.
+ */
+static void openBackingFile()
+{
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uint64_t numChunks = chunksX * chunksY;
+	int fd;
+
+	chunkStride = (sizeof(struct Chunk) + page - 1) / page * page;
+	fd = open(backingPath,O_RDWR|O_CREAT|O_TRUNC,0600);
+	if (fd < 0) {
+		fprintf(stderr,"[ERROR] Could not create backing file %s.\n",backingPath);
+		exit(1);
+	}
+	if (ftruncate(fd,(off_t)(numChunks * chunkStride))) {
+		fprintf(stderr,"[ERROR] Could not size backing file %s to %lu bytes.\n",backingPath,numChunks * chunkStride);
+		exit(1);
+	}
+	chunkBase = mmap(NULL,numChunks * chunkStride,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_NORESERVE,fd,0);
+	if (chunkBase == MAP_FAILED) {
+		fprintf(stderr,"[ERROR] Could not map backing file %s.\n",backingPath);
+		exit(1);
+	}
+	close(fd);
+	unlink(backingPath);
+
+	lruPrev = calloc(numChunks + 1,sizeof(*lruPrev));
+	lruNext = calloc(numChunks + 1,sizeof(*lruNext));
+	chunkState = calloc(numChunks,sizeof(*chunkState));
+	coldSummary = calloc(numChunks,sizeof(*coldSummary));
+	if (!lruPrev||!lruNext||!chunkState||!coldSummary) {
+		fprintf(stderr,"[ERROR] Out of memory allocating the chunk LRU.\n");
+		exit(1);
+	}
+	lruPrev[numChunks] = lruNext[numChunks] = numChunks;
+
+	fprintf(stderr,"[INFO] Backing file %s, %lu GiB mapped, %lu hot chunks\n",
+		backingPath,numChunks * chunkStride >> 30,hotChunkLimit);
+}
+#endif
+
+/**
+ * Prints one CSV stats line from the resident chunks and frees chunks that
+ * have been dead for chunkReleaseAge ticks. Only called between batches.
+ */
+static void printStats(const uintptr_t clock, uint64_t *lastTotalViableReplicators, const int verbose)
+{
+	uint64_t ci;
+	uintptr_t i;
+
+	uint64_t totalActiveCells = 0;
+	uint64_t totalEnergy = 0;
+	uint64_t totalViableReplicators = 0;
+	uintptr_t maxGeneration = 0;
+	uint64_t released = 0;
+	struct ChunkSummary sum;
+
+	for(ci=0;ci<chunksX * chunksY;++ci) {
+		struct Chunk *const ch = atomic_load_explicit(&chunkTable[ci],memory_order_relaxed);
+		if (!ch)
+			continue;
+#ifdef OUT_OF_CORE
+		/* Cold chunks are only changed by executions in them and by SHARE,
+		 * KILL and offspring across their edges, all of which send them back
+		 * to STALE (see wroteCell()), so the summary from the first scan
+		 * after they left the LRU stands in for reading them back from disk.
+		 * Releasing one punches a hole in the file, though, so that is only
+		 * decided on a fresh read. */
+		if ((chunkState[ci] == CHUNK_COLD)&&((!chunkDeadSince[ci])||((clock - chunkDeadSince[ci]) < chunkReleaseAge)))
+			sum = coldSummary[ci];
+		else if (chunkState[ci] == CHUNK_COLD) {
+			summarizeChunk(ch,&sum);
+			coldSummary[ci] = sum;
+		} else {
+			summarizeChunk(ch,&sum);
+			if (chunkState[ci] == CHUNK_STALE) {
+				coldSummary[ci] = sum;
+				chunkState[ci] = CHUNK_COLD;
+				adviseChunk(ci,COLD_ADVICE);
+			}
+		}
+#else
+		summarizeChunk(ch,&sum);
+#endif
+		totalActiveCells += sum.active;
+		totalEnergy += sum.energy;
+		totalViableReplicators += sum.viable;
+		if (sum.maxGeneration > maxGeneration)
+			maxGeneration = sum.maxGeneration;
+
+		if (sum.active)
+			chunkDeadSince[ci] = 0;
+		else if (!chunkDeadSince[ci])
+			chunkDeadSince[ci] = clock;
+		else if ((clock - chunkDeadSince[ci]) >= chunkReleaseAge) {
+			atomic_store_explicit(&chunkTable[ci],NULL,memory_order_relaxed);
+			chunkDeadSince[ci] = 0;
+#ifdef OUT_OF_CORE
+			/* Punching a hole zeroes the chunk, i.e. blanks it */
+			adviseChunk(ci,MADV_REMOVE);
+			if (chunkState[ci] == CHUNK_HOT) {
+				lruUnlink(ci);
+				--hotChunks;
+			}
+			chunkState[ci] = CHUNK_STALE;
+#else
+			free(ch);
+#endif
+			atomic_fetch_sub(&residentChunks,1);
+			++released;
+		}
+	}
+
+	/* Look here to get the columns in the CSV output */
+	/* The first five are here and are self-explanatory */
+	printf("%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+		(uint64_t)clock,
+		(uint64_t)totalEnergy,
+		(uint64_t)totalActiveCells,
+		(uint64_t)totalViableReplicators,
+		(uint64_t)maxGeneration,
+		(uint64_t)statCounters.viableCellsReplaced,
+		(uint64_t)statCounters.viableCellsKilled,
+		(uint64_t)statCounters.viableCellShares
+	);
+
+	/* The next 16 are the average frequencies of execution for each instruction per cell execution. */
+	double totalMetabolism = 0.0;
+	for(i=0;i<16;++i) {
+		totalMetabolism += statCounters.instructionExecutions[i];
+		printf(",%.4f",
+			(statCounters.cellExecutions > 0.0)
+			? (statCounters.instructionExecutions[i] / statCounters.cellExecutions)
+			: 0.0);
+	}
+
+	/* The last column is the average metabolism per cell execution */
+	printf(",%.4f\n",
+			(statCounters.cellExecutions > 0.0)
+			? (totalMetabolism / statCounters.cellExecutions)
+			: 0.0);
+	fflush(stdout);
+
+	if (verbose)
+		fprintf(stderr,"[INFO] %lu of %lu chunks resident (%lu MiB reserved), %lu released\n",
+			(uint64_t)atomic_load(&residentChunks),chunksX * chunksY,
+			(uint64_t)atomic_load(&residentChunks) * sizeof(struct Chunk) / (1024 * 1024),released);
+
+	if ((*lastTotalViableReplicators > 0)&&(totalViableReplicators == 0))
+		fprintf(stderr,
+			"[EVENT] Viable replicators have gone extinct. "\
+			"Please reserve a moment of silence.\n");
+	else
+		if ((*lastTotalViableReplicators == 0)&&(totalViableReplicators > 0))
+			fprintf(stderr,"[EVENT] Viable replicators have appeared!\n");
+
+	*lastTotalViableReplicators = totalViableReplicators;
+
+	/* Reset per-update stat counters */
+	memset(&statCounters,0,sizeof(statCounters));
+}
+
+static void doClockUpdate(const uintptr_t clock)
+{
+	static uint64_t lastTotalViableReplicators = 0;
+	printStats(clock,&lastTotalViableReplicators,0);
+}
+
+static void doUpdate(const uintptr_t clock)
+{
+	static uint64_t lastTotalViableReplicators = 0;
+	printStats(clock,&lastTotalViableReplicators,1);
+}
+
+/**
+ * Reports viable cells in the resident chunks; absent chunks have none.
+ */
+static void doReport(const uintptr_t clock)
+{
+	char buf[MAX_NUM_INSTR*2];
+	FILE *d;
+	uint64_t ci;
+	uintptr_t c,wordPtr,shiftPtr,inst,stopCount,i;
+
+	sprintf(buf,"p%lu.report.csv",clock);
+	d = fopen(buf,"w");
+	if (!d) {
+		fprintf(stderr,"[WARNING] Could not open %s for writing.\n",buf);
+		return;
+	}
+
+	fprintf(stderr,"[INFO] Reporting viable cells to %s\n",buf);
+
+	for(ci=0;ci<chunksX * chunksY;++ci) {
+		struct Chunk *const ch = atomic_load_explicit(&chunkTable[ci],memory_order_relaxed);
+		if (!ch)
+			continue;
+		for(c=0;c<CHUNK_CELLS;++c) {
+			struct Cell *const currCell = &ch->cells[c];
+			if (!(currCell->energy&&(currCell->generation > 2)))
+				continue;
+			fprintf(d,"ID: %lu, parent ID: %lu, lineage: %lu, generation: %lu\n",
+				(uint64_t)currCell->ID,
+				(uint64_t)currCell->parentID,
+				(uint64_t)currCell->lineage,
+				(uint64_t)currCell->generation);
+			wordPtr = 0;
+			shiftPtr = 0;
+			stopCount = 0;
+			for(i=0;i<MAX_NUM_INSTR;++i) {
+				inst = (GENOME_WORD(currCell,wordPtr) >> shiftPtr) & 0xf;
+				/* Four STOP instructions in a row is considered the end. */
+				fprintf(d,"%lx",inst);
+				if (inst == 0xf) { /* STOP */
+					if (++stopCount >= 4)
+						break;
+				} else
+					stopCount = 0;
+
+				if ((shiftPtr += 4) >= BITS_IN_WORD) {
+					if (++wordPtr >= MAX_WORDS_GENOME) {
+						wordPtr = 0;
+						shiftPtr = 4;
+					} else
+						shiftPtr = 0;
+				}
+			}
+		}
+	}
+	fclose(d);
+}
+
+/**
+ * Determines if c1 is allowed to access c2
+ */
+static inline int accessAllowed(struct Cell *const c2,const uintptr_t c1guess,int sense, int currRNG)
+{
+	/* Access permission is more probable if they are more similar in sense 0,
+	* and more probable if they are different in sense 1. Sense 0 is used for
+	* "negative" interactions and sense 1 for "positive" ones. */
+	return sense
+		? (((getRandomFromArray(currRNG) & 0xf) >=
+			BITS_IN_FOURBIT_WORD[(GENOME_WORD(c2,0) & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID))
+		: (((getRandomFromArray(currRNG) & 0xf) <=
+			BITS_IN_FOURBIT_WORD[(GENOME_WORD(c2,0) & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID));
+}
+
+//array of locations where the threads can go to get the location of a random cell
+static uint64_t *randomLocationX;
+static uint64_t *randomLocationY;
+
+#ifdef OUT_OF_CORE
+//the batch after this one, picked early so its chunks can be read in
+static uint64_t *upcomingLocationX;
+static uint64_t *upcomingLocationY;
+#endif
+
+static void pickBatch(uint64_t *locX,uint64_t *locY) {
+	uintptr_t i;
+	for (i = 0; i < batchSize; i++) {
+		locX[i] = getRandomFromArray(pickerRNG) % pondSizeX;
+		locY[i] = getRandomFromArray(pickerRNG) % pondSizeY;
+	}
+}
+
+static int executeCell(const uint64_t x, const uint64_t y) {
+	struct Chunk *const ch = atomic_load_explicit(&chunkTable[chunkIndex(x,y)],memory_order_acquire);
+	if ((!ch)||(!ch->cells[cellInChunk(x,y)].energy)) {
+		return 0;
+	}
+	// A batch can touch more chunks than stay hot, so this one may be cold by now //
+	wroteCell(x,y);
+
+	uintptr_t ptr_wordPtr = 0;
+	uintptr_t ptr_shiftPtr = 0;
+	uintptr_t reg = 0;
+	uintptr_t loopStack_wordPtr[MAX_NUM_INSTR];
+	uintptr_t loopStack_shiftPtr[MAX_NUM_INSTR];
+	uintptr_t loopStackPtr = 0;
+	uintptr_t wordPtr = EXEC_START_WORD;
+	uintptr_t shiftPtr = EXEC_START_BIT;
+	uintptr_t facing = 0;
+	uintptr_t falseLoopDepth = 0;
+	int stop = 0;
+	uintptr_t currentWord;
+	uintptr_t inst, tmp;
+	uint64_t nx, ny;
+	struct Cell *const currCell = &ch->cells[cellInChunk(x,y)];
+	getNeighbor(x, y, facing, &nx, &ny);
+	struct Cell *neighborCell = peekCell(nx, ny);
+
+	const int currRNG = omp_get_thread_num();
+	currentWord = GENOME_WORD(currCell,0);
+
+	int i;
+	uintptr_t outputBuf[MAX_WORDS_GENOME];
+	for(i=0;i<MAX_WORDS_GENOME;++i)
+		outputBuf[i] = ~((uintptr_t)0);
+	uint64_t instrExecs[16] = {0};
+	uint64_t cellsReplaced = 0;
+	uint64_t cellsKilled = 0;
+	uint64_t cellsShared = 0;
+
+	while (currCell->energy&&(!stop)) {
+		inst = (currentWord >> shiftPtr) & 0xf;
+		instrExecs[inst] += 1.0;
+
+		if ((getRandomFromArray(currRNG) & 0xffffffff) < MUTATION_RATE) {
+			tmp = getRandomFromArray(currRNG);
+			if (tmp & 0x80) // Check for the 8th bit to get random boolean //
+				inst = tmp & 0xf; // Only the first four bits are used here //
+			else reg = tmp & 0xf;
+		}
+
+		--currCell->energy;
+
+		if (falseLoopDepth) {
+			if (inst == 0x9)
+				++falseLoopDepth;
+			else if (inst == 0xa)
+				--falseLoopDepth;
+		} else {
+			switch(inst) {
+				case 0x0: // ZERO: Zero VM state registers //
+					reg = 0;
+					ptr_wordPtr = 0;
+					ptr_shiftPtr = 0;
+					facing = 0;
+					break;
+				case 0x1: // FWD: Increment the pointer (wrap at end) //
+					if ((ptr_shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++ptr_wordPtr >= MAX_WORDS_GENOME)
+							ptr_wordPtr = 0;
+						ptr_shiftPtr = 0;
+					}
+					break;
+				case 0x2: // BACK: Decrement the pointer (wrap at beginning) //
+					if (ptr_shiftPtr)
+						ptr_shiftPtr -= 4;
+					else {
+						if (ptr_wordPtr)
+							--ptr_wordPtr;
+						else ptr_wordPtr = MAX_WORDS_GENOME - 1;
+						ptr_shiftPtr = BITS_IN_WORD - 4;
+					}
+					break;
+				case 0x3: // INC: Increment the register //
+					reg = (reg + 1) & 0xf;
+					break;
+				case 0x4: // DEC: Decrement the register //
+					reg = (reg - 1) & 0xf;
+					break;
+				case 0x5: // READG: Read into the register from genome //
+					reg = (GENOME_WORD(currCell,ptr_wordPtr) >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x6: // WRITEG: Write out from the register to genome //
+					currCell->genome[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					currCell->genome[ptr_wordPtr] |= (reg ^ 0xf) << ptr_shiftPtr;
+					currentWord = GENOME_WORD(currCell,wordPtr); // Must refresh in case this changed! //
+					break;
+				case 0x7: // READB: Read into the register from buffer //
+					reg = (outputBuf[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x8: // WRITEB: Write out from the register to buffer //
+					outputBuf[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					outputBuf[ptr_wordPtr] |= reg << ptr_shiftPtr;
+					break;
+				case 0x9: // LOOP: Jump forward to matching REP if register is zero //
+					if (reg) {
+						if (loopStackPtr >= MAX_NUM_INSTR)
+							stop = 1; // Stack overflow ends execution //
+						else {
+							loopStack_wordPtr[loopStackPtr] = wordPtr;
+							loopStack_shiftPtr[loopStackPtr] = shiftPtr;
+							++loopStackPtr;
+						}
+					} else falseLoopDepth = 1;
+					break;
+				case 0xa: // REP: Jump back to matching LOOP if register is nonzero //
+					if (loopStackPtr) {
+						--loopStackPtr;
+						if (reg) {
+							wordPtr = loopStack_wordPtr[loopStackPtr];
+							shiftPtr = loopStack_shiftPtr[loopStackPtr];
+							currentWord = GENOME_WORD(currCell,wordPtr);
+							// This ensures that the LOOP is rerun //
+							continue;
+						}
+					}
+					break;
+				case 0xb: // TURN: Turn in the direction specified by register //
+					facing = reg & 3;
+					break;
+				case 0xc: // XCHG: Skip next instruction and exchange value of register with it //
+					if ((shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++wordPtr >= MAX_WORDS_GENOME) {
+							wordPtr = EXEC_START_WORD;
+							shiftPtr = EXEC_START_BIT;
+						} else shiftPtr = 0;
+					}
+					tmp = reg;
+					reg = (GENOME_WORD(currCell,wordPtr) >> shiftPtr) & 0xf;
+					currCell->genome[wordPtr] &= ~(((uintptr_t)0xf) << shiftPtr);
+					currCell->genome[wordPtr] |= (tmp ^ 0xf) << shiftPtr;
+					currentWord = GENOME_WORD(currCell,wordPtr);
+					break;
+				case 0xd: // KILL: Blow away neighboring cell if allowed with penalty on failure //
+					getNeighbor(x,y,facing,&nx,&ny);
+					neighborCell = peekCell(nx,ny);
+					if (accessAllowed(neighborCell,reg,0,currRNG)) {
+						if (neighborCell->generation > 2)
+							++cellsKilled;
+
+						// An absent cell is already blank //
+						if (neighborCell != &emptyCell) {
+							// Filling first two words with 0xfffff... is enough //
+							SET_GENOME_WORD(neighborCell,0,~((uintptr_t)0));
+							SET_GENOME_WORD(neighborCell,1,~((uintptr_t)0));
+							neighborCell->parentID = 0;
+							neighborCell->generation = 0;
+							wroteCell(nx,ny);
+						}
+					} else if (neighborCell->generation > 2) {
+						tmp = currCell->energy / FAILED_KILL_PENALTY;
+						if (currCell->energy > tmp)
+							currCell->energy -= tmp;
+						else currCell->energy = 0;
+					}
+					break;
+				case 0xe: // SHARE: Equalize energy between self and neighbor if allowed //
+					getNeighbor(x,y,facing,&nx,&ny);
+					neighborCell = peekCell(nx,ny);
+					if (accessAllowed(neighborCell,reg,1,currRNG)) {
+						if (neighborCell->generation > 2)
+							++cellsShared;
+
+						// Energy flowing into an absent chunk brings it into memory //
+						if (neighborCell == &emptyCell)
+							neighborCell = touchCell(nx,ny);
+						tmp = currCell->energy + neighborCell->energy;
+						neighborCell->energy = tmp / 2;
+						currCell->energy = tmp - neighborCell->energy;
+						wroteCell(nx,ny);
+					}
+					break;
+				case 0xf: // STOP: End execution //
+					stop = 1;
+					break;
+			} // end switch
+		} // end else for falseLoopDepth
+
+		if ((shiftPtr += 4) >= BITS_IN_WORD) {
+			if (++wordPtr >= MAX_WORDS_GENOME) {
+				wordPtr = EXEC_START_WORD;
+				shiftPtr = EXEC_START_BIT;
+			} else shiftPtr = 0;
+			currentWord = GENOME_WORD(currCell,wordPtr);
+		} // end if
+	} // end while
+
+	// Offspring need a living neighbor, so they never land in an absent chunk
+	if ((outputBuf[0] & 0xff) != 0xff) {
+		if ((neighborCell->energy)&&accessAllowed(neighborCell,reg,0,currRNG)) {
+			if (neighborCell->generation > 2)
+				++cellsReplaced;
+
+			neighborCell->parentID = currCell->ID;
+			neighborCell->lineage = currCell->lineage;
+			neighborCell->generation = currCell->generation + 1;
+			for(i=0;i<MAX_WORDS_GENOME;++i)
+				SET_GENOME_WORD(neighborCell,i,outputBuf[i]);
+			wroteCell(nx,ny);
+		}
+	}
+
+	#pragma omp critical
+	{
+		for (i = 0; i < 16; i++) {
+			statCounters.instructionExecutions[i] += instrExecs[i];
+		}
+		statCounters.viableCellsReplaced += cellsReplaced;
+		statCounters.viableCellsKilled += cellsKilled;
+		statCounters.viableCellShares += cellsShared;
+	}
+	return 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-x width] [-y height] [-b batch] [-r release age]\n"
+		"  -x  pond width in cells (default %d)\n"
+		"  -y  pond height in cells (default %d)\n"
+		"  -b  cells executed per parallel batch, at least %d and dividing %d (default %d)\n"
+		"  -r  ticks a chunk stays dead before it is freed (default %d)\n"
+#ifdef OUT_OF_CORE
+		"  -f  backing file, created and unlinked (default %s)\n"
+		"  -c  chunks kept resident (default %d)\n"
+#endif
+		,prog,POND_SIZE_X,POND_SIZE_Y,INFLOW_FREQUENCY,CLOCKUPDATE_FREQUENCY,BATCH_SIZE,CHUNK_RELEASE_AGE
+#ifdef OUT_OF_CORE
+		,BACKING_FILE,HOT_CHUNKS
+#endif
+		);
+}
+
+//main
+int main(int argc, char **argv)  {
+	struct timeval runStart, runStop;
+	gettimeofday(&runStart, NULL);
+
+	int opt, i, numThreads;
+	uint64_t x, y;
+	uintptr_t j;
+	struct Cell *currCell;
+	uintptr_t clock = 0;
+	uint64_t cellIDCounter = 0;
+
+#ifdef OUT_OF_CORE
+	while ((opt = getopt(argc,argv,"x:y:b:r:f:c:h")) != -1) {
+#else
+	while ((opt = getopt(argc,argv,"x:y:b:r:h")) != -1) {
+#endif
+		switch(opt) {
+			case 'x': pondSizeX = strtoull(optarg,NULL,0); break;
+			case 'y': pondSizeY = strtoull(optarg,NULL,0); break;
+			case 'b': batchSize = strtoul(optarg,NULL,0); break;
+			case 'r': chunkReleaseAge = strtoul(optarg,NULL,0); break;
+#ifdef OUT_OF_CORE
+			case 'f': backingPath = optarg; break;
+			case 'c': hotChunkLimit = strtoull(optarg,NULL,0); break;
+#endif
+			default: usage(argv[0]); exit(opt == 'h' ? 0 : 1);
+		}
+	}
+	if ((pondSizeX < 2)||(pondSizeY < 2)||(batchSize < INFLOW_FREQUENCY)
+#ifdef OUT_OF_CORE
+		||(hotChunkLimit < 1)
+#endif
+		) {
+		usage(argv[0]);
+		exit(1);
+	}
+	/* Stats, updates, reports and chunk release happen when the clock, which
+	 * moves a batch at a time, lands on a multiple of their frequency */
+	if ((CLOCKUPDATE_FREQUENCY % batchSize)||(UPDATE_FREQUENCY % batchSize)||(REPORT_FREQUENCY % batchSize)) {
+		fprintf(stderr,"[ERROR] Batch size must divide %d, %d and %d.\n",CLOCKUPDATE_FREQUENCY,UPDATE_FREQUENCY,REPORT_FREQUENCY);
+		exit(1);
+	}
+
+	chunksX = (pondSizeX + CHUNK_SIDE - 1) / CHUNK_SIDE;
+	chunksY = (pondSizeY + CHUNK_SIDE - 1) / CHUNK_SIDE;
+	numThreads = omp_get_max_threads();
+	pickerRNG = numThreads;
+
+	chunkTable = calloc(chunksX * chunksY,sizeof(*chunkTable));
+	chunkDeadSince = calloc(chunksX * chunksY,sizeof(*chunkDeadSince));
+	rngArray = malloc((numThreads + 1) * sizeof(*rngArray));
+	rngIndexArray = malloc((numThreads + 1) * sizeof(*rngIndexArray));
+	randomLocationX = malloc(batchSize * sizeof(*randomLocationX));
+	randomLocationY = malloc(batchSize * sizeof(*randomLocationY));
+	if (!chunkTable||!chunkDeadSince||!rngArray||!rngIndexArray||!randomLocationX||!randomLocationY) {
+		fprintf(stderr,"[ERROR] Out of memory allocating a %lux%lu chunk table.\n",chunksX,chunksY);
+		exit(1);
+	}
+#ifdef OUT_OF_CORE
+	upcomingLocationX = malloc(batchSize * sizeof(*upcomingLocationX));
+	upcomingLocationY = malloc(batchSize * sizeof(*upcomingLocationY));
+	if (!upcomingLocationX||!upcomingLocationY) {
+		fprintf(stderr,"[ERROR] Out of memory allocating the pick lookahead.\n");
+		exit(1);
+	}
+	openBackingFile();
+#endif
+
+	// Seeding each thread's RNG and the cell picker
+	for (i = 0; i <= numThreads; i++)
+		init_genrand(i,1234567890 + i);
+	for(i=0;i<1024;++i)
+		getRandomFromArray(pickerRNG);
+
+	fprintf(stderr,"[INFO] Pond %lux%lu in %lux%lu chunks of %lu KiB, %d threads\n",
+		pondSizeX,pondSizeY,chunksX,chunksY,(uint64_t)sizeof(struct Chunk) / 1024,numThreads);
+
+#ifdef OUT_OF_CORE
+	pickBatch(upcomingLocationX,upcomingLocationY);
+#endif
+
+	// Batch execution loop
+	for (;;){
+#ifdef OUT_OF_CORE
+		// the upcoming batch becomes this one, and the next one is picked and
+		// warmed while this one runs
+		uint64_t *swap;
+		swap = randomLocationX; randomLocationX = upcomingLocationX; upcomingLocationX = swap;
+		swap = randomLocationY; randomLocationY = upcomingLocationY; upcomingLocationY = swap;
+		pickBatch(upcomingLocationX,upcomingLocationY);
+		warmBatch(upcomingLocationX,upcomingLocationY);
+#else
+		// picking next batchSize random locations to execute
+		pickBatch(randomLocationX,randomLocationY);
+#endif
+
+// Parallel for loop to execute each cell
+#pragma omp parallel private(i)
+{
+		#pragma omp for
+		for (i = 0; i < batchSize; i++)
+			executeCell(randomLocationX[i], randomLocationY[i]);
+}
+
+		// Increment clock and number of cell executions by batch size
+		clock += batchSize;
+		statCounters.cellExecutions += batchSize;
+
+		// Introduce random cell with energy. Do this as many times as needed relative to batch size.
+		for (i = 0; i < batchSize / INFLOW_FREQUENCY; i++) {
+			x = getRandomFromArray(pickerRNG) % pondSizeX;
+			y = getRandomFromArray(pickerRNG) % pondSizeY;
+			currCell = touchCell(x,y);
+#ifdef OUT_OF_CORE
+			warmChunk(chunkIndex(x,y));
+#endif
+			currCell->ID = cellIDCounter;
+			currCell->parentID = 0;
+			currCell->lineage = cellIDCounter;
+			currCell->generation = 0;
+#ifdef INFLOW_RATE_VARIATION
+			currCell->energy += INFLOW_RATE_BASE + (getRandomFromArray(pickerRNG) % INFLOW_RATE_VARIATION);
+#else
+			currCell->energy += INFLOW_RATE_BASE;
+#endif
+			for(j=0;j<MAX_WORDS_GENOME;++j)
+				SET_GENOME_WORD(currCell,j,getRandomFromArray(pickerRNG));
+			++cellIDCounter;
+		}
+
+#ifdef STOP_AT
+		if ((clock >= STOP_AT)) {
+			gettimeofday(&runStop, NULL);
+			printf("run start: %lf run stop: %lf difference: %lf \n", (float) runStart.tv_sec, (float) runStop.tv_sec, (runStop.tv_sec - runStart.tv_sec) + (runStop.tv_usec - runStart.tv_usec)/1000000.0);
+			exit(0);
+		}
+#endif
+
+		// Do updates and reports at defined intervals
+		if (!(clock % CLOCKUPDATE_FREQUENCY))
+			doClockUpdate(clock);
+		if (!(clock % UPDATE_FREQUENCY))
+			doUpdate(clock);
+		if (!(clock % REPORT_FREQUENCY))
+			doReport(clock);
+	} // end batch execution loop
+	exit(0);
+}
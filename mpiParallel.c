@@ -0,0 +1,799 @@
+/* MPI version of parallelEdit.c.
+ *
+ * The torus is cut into vertical strips of whole columns, one strip per
+ * rank. Since cellArray is stored [x][y], a strip is one contiguous block.
+ * Each rank allocates only its own columns plus one halo column on either
+ * side, and only the per-cell RNGs of the cells it owns.
+ *
+ * Every rank runs the same cell picker RNG, so all ranks agree on the batch
+ * and on inflow; each rank executes only the picks that land in its strip.
+ * A cell on the edge of a strip reads its outside neighbor from the halo
+ * column. KILL, SHARE and offspring placement into a halo cell are applied
+ * to the halo copy and also queued as a message for the owning rank, which
+ * applies them after the batch. Boundary columns are then re-sent as halos.
+ *
+ * Build with "make mpip" and run with e.g. "mpirun -np 4 ./mpip". Reports
+ * are written per rank as p<clock>.<rank>.report.csv; concatenating them in
+ * rank order gives the same cell order as the single process report.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+// pond constants
+#define STOP_AT 3000000
+#define UPDATE_FREQUENCY 100000
+#define REPORT_FREQUENCY 10000000
+#define MUTATION_RATE 21475
+#define INFLOW_FREQUENCY 100
+#define INFLOW_RATE_BASE 4000
+#define INFLOW_RATE_VARIATION 8000
+#define POND_SIZE_X 640
+#define POND_SIZE_Y 480
+#define MAX_NUM_INSTR 512
+#define FAILED_KILL_PENALTY 2
+
+// picks per batch across all ranks; halos are exchanged once per batch
+#define BATCH_SIZE 1000
+
+#define MAX_WORDS_GENOME (MAX_NUM_INSTR / (sizeof(uintptr_t) * 2))
+#define BITS_IN_WORD (sizeof(uintptr_t) * 8)
+#define N_LEFT 0
+#define N_RIGHT 1
+#define N_UP 2
+#define N_DOWN 3
+#define EXEC_START_WORD 0
+#define EXEC_START_BIT 4
+
+// message types forwarded to the rank that owns a halo cell
+#define MSG_KILL 0
+#define MSG_SHARE 1
+#define MSG_OFFSPRING 2
+
+// strip geometry of this rank
+static int rank, numRanks, leftRank, rightRank;
+static uintptr_t stripStart;	/* global x of the first owned column */
+static uintptr_t stripWidth;	/* number of owned columns */
+
+// RNG variables; indexes and arrays
+// RNG functions
+#define N 624
+#define M 397
+#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
+#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
+#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
+
+// one RNG per owned cell plus the cell picker at index cellPickIndex
+static unsigned long (*rngArray)[N];
+static int *rngIndexArray;
+static int cellPickIndex;
+
+static void init_genrandArray(unsigned long s)
+{
+	int i, j;
+	for (i = 0; i <= cellPickIndex; i++) {
+		rngArray[i][0] = (s) & 0xffffffffUL;
+		for (j = 1; j < N; j++) {
+			rngArray[i][j] = (1812433253UL * (rngArray[i][j-1] ^ (rngArray[i][j-1] >> 30)) + j);
+			rngArray[i][j] &= 0xffffffffUL;
+		}
+		rngIndexArray[i] = N;
+	}
+}
+
+static inline uint32_t genrand_int32Array(int whichRNG) {
+	uint32_t y;
+	static uint32_t mag01[2]={0x0UL, MATRIX_A};
+	unsigned long *mt = rngArray[whichRNG];
+
+	if (rngIndexArray[whichRNG] >= N) { /* generate N words at one time */
+		int kk;
+		for (kk=0;kk<N-M;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		for (;kk<N-1;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
+		mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+
+		rngIndexArray[whichRNG] = 0;
+	}
+
+	y = mt[rngIndexArray[whichRNG]++];
+
+	/* Tempering */
+	y ^= (y >> 11);
+	y ^= (y << 7) & 0x9d2c5680UL;
+	y ^= (y << 15) & 0xefc60000UL;
+	y ^= (y >> 18);
+
+	return y;
+}
+
+static inline uintptr_t getRandomFromArray(int whichRNG)
+{
+	if (sizeof(uintptr_t) == 8)
+		return (uintptr_t)((((uint64_t)genrand_int32Array(whichRNG)) << 32) ^ ((uint64_t)genrand_int32Array(whichRNG)));
+	return (uintptr_t)genrand_int32Array(whichRNG);
+}
+
+//central structures
+static const uintptr_t BITS_IN_FOURBIT_WORD[16] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
+
+struct Cell {
+	uint64_t ID;            /* Globally unique cell ID */
+	uint64_t parentID;      /* ID of the cell's parent */
+	uint64_t lineage;       /* Equal to the cell ID of the first cell in the line. */
+	uintptr_t generation;       /* Generations start at 0 and are incremented from there. */
+	uintptr_t energy;       /* Energy level of this cell */
+	uintptr_t genome[MAX_WORDS_GENOME];/* four-bit instructions packed into machine-size words */
+};
+
+// (stripWidth + 2) columns of POND_SIZE_Y cells; columns 0 and stripWidth + 1 are halos
+static struct Cell *cellArray;
+#define LOCAL_CELL(lx,y) (&cellArray[(lx) * POND_SIZE_Y + (y)])
+
+// The only neighbor state a cell ever reads is what accessAllowed() and
+// offspring placement look at, so that is all a halo carries.
+struct HaloCell {
+	uint64_t parentID;
+	uintptr_t generation;
+	uintptr_t energy;
+	uintptr_t logo;         /* genome[0] */
+};
+
+struct HaloMessage {
+	uint64_t type;
+	uint64_t y;
+	int64_t energyDelta;    /* MSG_SHARE: energy moved into the target cell */
+	struct Cell cell;       /* MSG_OFFSPRING: parentID, lineage, generation and genome to write */
+};
+
+// outgoing messages; [0] goes to leftRank, [1] to rightRank
+static struct HaloMessage *outbox[2];
+static size_t outboxCount[2], outboxSize[2];
+static struct HaloMessage *inbox;
+static size_t inboxSize;
+
+static struct HaloCell *haloSend, *haloRecv;
+
+struct PerUpdateStatCounters
+{
+	double instructionExecutions[16];/* Per-instruction-type execution count since last update. */
+	double cellExecutions;      /* Number of cells executed since last update */
+	uint64_t viableCellsReplaced;  /* Number of viable cells replaced by other cells' offspring */
+	uint64_t viableCellsKilled;    /* Number of viable cells KILLed */
+	uint64_t viableCellShares; /* Number of successful SHARE operations */
+};
+
+struct PerUpdateStatCounters statCounters;
+
+static void *allocOrDie(size_t bytes, const char *what)
+{
+	void *p = malloc(bytes);
+	if (!p) {
+		fprintf(stderr,"[ERROR] rank %d could not allocate %zu bytes for %s\n",rank,bytes,what);
+		MPI_Abort(MPI_COMM_WORLD,1);
+	}
+	return p;
+}
+
+static void doUpdate(const uint64_t clock)
+{
+	static uint64_t lastTotalViableReplicators = 0;
+
+	uintptr_t lx,y;
+	int i;
+
+	// totals[]: energy, active cells, viable replicators, replaced, killed, shares
+	uint64_t totals[6] = {0}, globalTotals[6];
+	uint64_t maxGeneration = 0, globalMaxGeneration;
+	double execs[17], globalExecs[17];
+
+	for(lx=1;lx<=stripWidth;++lx) {
+		for(y=0;y<POND_SIZE_Y;++y) {
+			struct Cell *const c = LOCAL_CELL(lx,y);
+			if (c->energy) {
+				++totals[1];
+				totals[0] += (uint64_t)c->energy;
+				if (c->generation > 2)
+					++totals[2];
+				if (c->generation > maxGeneration)
+					maxGeneration = c->generation;
+			}
+		}
+	}
+	totals[3] = statCounters.viableCellsReplaced;
+	totals[4] = statCounters.viableCellsKilled;
+	totals[5] = statCounters.viableCellShares;
+	for(i=0;i<16;++i)
+		execs[i] = statCounters.instructionExecutions[i];
+	execs[16] = statCounters.cellExecutions;
+
+	MPI_Reduce(totals,globalTotals,6,MPI_UINT64_T,MPI_SUM,0,MPI_COMM_WORLD);
+	MPI_Reduce(&maxGeneration,&globalMaxGeneration,1,MPI_UINT64_T,MPI_MAX,0,MPI_COMM_WORLD);
+	MPI_Reduce(execs,globalExecs,17,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+
+	/* Reset per-update stat counters */
+	memset(&statCounters,0,sizeof(statCounters));
+
+	if (rank)
+		return;
+
+	/* Same columns as parallelEdit.c */
+	printf("%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+		clock,
+		globalTotals[0],
+		globalTotals[1],
+		globalTotals[2],
+		globalMaxGeneration,
+		globalTotals[3],
+		globalTotals[4],
+		globalTotals[5]
+	);
+
+	/* Every rank counts each pick it executes, so the sum is the pond-wide count */
+	double totalMetabolism = 0.0;
+	for(i=0;i<16;++i) {
+		totalMetabolism += globalExecs[i];
+		printf(",%.4f",(globalExecs[16] > 0.0) ? (globalExecs[i] / globalExecs[16]) : 0.0);
+	}
+	printf(",%.4f\n",(globalExecs[16] > 0.0) ? (totalMetabolism / globalExecs[16]) : 0.0);
+	fflush(stdout);
+
+	if ((lastTotalViableReplicators > 0)&&(globalTotals[2] == 0))
+		fprintf(stderr,
+			"[EVENT] Viable replicators have gone extinct. "\
+			"Please reserve a moment of silence.\n");
+	else
+		if ((lastTotalViableReplicators == 0)&&(globalTotals[2] > 0))
+			fprintf(stderr,"[EVENT] Viable replicators have appeared!\n");
+
+	lastTotalViableReplicators = globalTotals[2];
+}
+
+static void doReport(const uint64_t clock)
+{
+	char buf[MAX_NUM_INSTR*2];
+	FILE *d;
+	uintptr_t lx,y,wordPtr,shiftPtr,inst,stopCount,i;
+	struct Cell *currCell;
+
+	sprintf(buf,"p%lu.%d.report.csv",clock,rank);
+	d = fopen(buf,"w");
+	if (!d) {
+		fprintf(stderr,"[WARNING] Could not open %s for writing.\n",buf);
+		return;
+	}
+
+	fprintf(stderr,"[INFO] Reporting viable cells to %s\n",buf);
+
+	for(lx=1;lx<=stripWidth;++lx) {
+		for(y=0;y<POND_SIZE_Y;++y) {
+			currCell = LOCAL_CELL(lx,y);
+			if (currCell->energy&&(currCell->generation > 2)) {
+				fprintf(d,"ID: %lu, parent ID: %lu, lineage: %lu, generation: %lu\n",
+					(uint64_t)currCell->ID,
+					(uint64_t)currCell->parentID,
+					(uint64_t)currCell->lineage,
+					(uint64_t)currCell->generation);
+				wordPtr = 0;
+				shiftPtr = 0;
+				stopCount = 0;
+				for(i=0;i<MAX_NUM_INSTR;++i) {
+					inst = (currCell->genome[wordPtr] >> shiftPtr) & 0xf;
+					/* Four STOP instructions in a row is considered the end. */
+					fprintf(d,"%lx",inst);
+					if (inst == 0xf) { /* STOP */
+						if (++stopCount >= 4)
+							break;
+					} else
+						stopCount = 0;
+
+					if ((shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++wordPtr >= MAX_WORDS_GENOME) {
+							wordPtr = 0;
+							shiftPtr = 4;
+						} else
+							shiftPtr = 0;
+					}
+				}
+			}
+		}
+	}
+	fclose(d);
+}
+
+/**
+ * Get a neighbor in the local strip. Left and right never wrap here: the
+ * halo columns stand in for the neighboring strips (or for the opposite
+ * edge of the pond when running on one rank).
+ */
+static inline struct Cell *getNeighbor(const uintptr_t lx,const uintptr_t y,const uintptr_t dir)
+{
+	switch(dir) {
+		case N_LEFT: 	return LOCAL_CELL(lx-1,y);
+		case N_RIGHT: 	return LOCAL_CELL(lx+1,y);
+		case N_UP: 	return (y) ? LOCAL_CELL(lx,y-1) : LOCAL_CELL(lx,POND_SIZE_Y-1);
+		case N_DOWN: 	return (y < (POND_SIZE_Y-1)) ? LOCAL_CELL(lx,y+1) : LOCAL_CELL(lx,0);
+	}
+	return LOCAL_CELL(lx,y); /* This should never be reached */
+}
+
+/**
+ * Determines if c1 is allowed to access c2
+ */
+static inline int accessAllowed(struct Cell *const c2,const uintptr_t c1guess,int sense, int currRNG)
+{
+	/* Access permission is more probable if they are more similar in sense 0,
+	* and more probable if they are different in sense 1. Sense 0 is used for
+	* "negative" interactions and sense 1 for "positive" ones. */
+	return sense
+		? (((getRandomFromArray(currRNG) & 0xf) >=
+			BITS_IN_FOURBIT_WORD[(c2->genome[0] & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID))
+		: (((getRandomFromArray(currRNG) & 0xf) <=
+			BITS_IN_FOURBIT_WORD[(c2->genome[0] & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID));
+}
+
+/**
+ * Returns a message slot for the rank owning the halo cell at (lx, y), or
+ * NULL if the cell is owned by this rank.
+ */
+static struct HaloMessage *postMessage(const uintptr_t lx,const uintptr_t y,const uint64_t type)
+{
+	int side;
+	struct HaloMessage *msg;
+
+	if (lx == 0)
+		side = 0;
+	else if (lx == stripWidth + 1)
+		side = 1;
+	else
+		return NULL;
+
+	if (outboxCount[side] == outboxSize[side]) {
+		outboxSize[side] = outboxSize[side] ? outboxSize[side] * 2 : 64;
+		outbox[side] = realloc(outbox[side],outboxSize[side] * sizeof(struct HaloMessage));
+		if (!outbox[side]) {
+			fprintf(stderr,"[ERROR] rank %d could not grow its outbox\n",rank);
+			MPI_Abort(MPI_COMM_WORLD,1);
+		}
+	}
+	msg = &outbox[side][outboxCount[side]++];
+	msg->type = type;
+	msg->y = y;
+	return msg;
+}
+
+static void executeCell(const uintptr_t lx, const uintptr_t y) {
+	struct Cell *currCell = LOCAL_CELL(lx,y);
+	if (!currCell->energy)
+		return;
+
+	uintptr_t ptr_wordPtr = 0;
+	uintptr_t ptr_shiftPtr = 0;
+	uintptr_t reg = 0;
+	uintptr_t loopStack_wordPtr[MAX_NUM_INSTR];
+	uintptr_t loopStack_shiftPtr[MAX_NUM_INSTR];
+	uintptr_t loopStackPtr = 0;
+	uintptr_t wordPtr = EXEC_START_WORD;
+	uintptr_t shiftPtr = EXEC_START_BIT;
+	uintptr_t facing = 0;
+	uintptr_t falseLoopDepth = 0;
+	int stop = 0;
+	uintptr_t currentWord;
+	uintptr_t inst, tmp;
+	uintptr_t nx, ny;
+	struct Cell *neighborCell;
+	struct HaloMessage *msg;
+
+	int currRNG = (lx - 1) + stripWidth * y;
+	currentWord = currCell->genome[0];
+
+	uintptr_t i;
+	uintptr_t outputBuf[MAX_WORDS_GENOME];
+	for(i=0;i<MAX_WORDS_GENOME;++i)
+		outputBuf[i] = ~((uintptr_t)0);
+
+	statCounters.cellExecutions += 1.0;
+
+	while (currCell->energy&&(!stop)) {
+		inst = (currentWord >> shiftPtr) & 0xf;
+		statCounters.instructionExecutions[inst] += 1.0;
+
+		if ((getRandomFromArray(currRNG) & 0xffffffff) < MUTATION_RATE) {
+			tmp = getRandomFromArray(currRNG);
+			if (tmp & 0x80) // Check for the 8th bit to get random boolean //
+				inst = tmp & 0xf; // Only the first four bits are used here //
+			else reg = tmp & 0xf;
+		}
+
+		--currCell->energy;
+
+		if (falseLoopDepth) {
+			if (inst == 0x9)
+				++falseLoopDepth;
+			else if (inst == 0xa)
+				--falseLoopDepth;
+		} else {
+			switch(inst) {
+				case 0x0: // ZERO: Zero VM state registers //
+					reg = 0;
+					ptr_wordPtr = 0;
+					ptr_shiftPtr = 0;
+					facing = 0;
+					break;
+				case 0x1: // FWD: Increment the pointer (wrap at end) //
+					if ((ptr_shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++ptr_wordPtr >= MAX_WORDS_GENOME)
+							ptr_wordPtr = 0;
+						ptr_shiftPtr = 0;
+					}
+					break;
+				case 0x2: // BACK: Decrement the pointer (wrap at beginning) //
+					if (ptr_shiftPtr)
+						ptr_shiftPtr -= 4;
+					else {
+						if (ptr_wordPtr)
+							--ptr_wordPtr;
+						else ptr_wordPtr = MAX_WORDS_GENOME - 1;
+						ptr_shiftPtr = BITS_IN_WORD - 4;
+					}
+					break;
+				case 0x3: // INC: Increment the register //
+					reg = (reg + 1) & 0xf;
+					break;
+				case 0x4: // DEC: Decrement the register //
+					reg = (reg - 1) & 0xf;
+					break;
+				case 0x5: // READG: Read into the register from genome //
+					reg = (currCell->genome[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x6: // WRITEG: Write out from the register to genome //
+					currCell->genome[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					currCell->genome[ptr_wordPtr] |= reg << ptr_shiftPtr;
+					currentWord = currCell->genome[wordPtr]; // Must refresh in case this changed! //
+					break;
+				case 0x7: // READB: Read into the register from buffer //
+					reg = (outputBuf[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x8: // WRITEB: Write out from the register to buffer //
+					outputBuf[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					outputBuf[ptr_wordPtr] |= reg << ptr_shiftPtr;
+					break;
+				case 0x9: // LOOP: Jump forward to matching REP if register is zero //
+					if (reg) {
+						if (loopStackPtr >= MAX_NUM_INSTR)
+							stop = 1; // Stack overflow ends execution //
+						else {
+							loopStack_wordPtr[loopStackPtr] = wordPtr;
+							loopStack_shiftPtr[loopStackPtr] = shiftPtr;
+							++loopStackPtr;
+						}
+					} else falseLoopDepth = 1;
+					break;
+				case 0xa: // REP: Jump back to matching LOOP if register is nonzero //
+					if (loopStackPtr) {
+						--loopStackPtr;
+						if (reg) {
+							wordPtr = loopStack_wordPtr[loopStackPtr];
+							shiftPtr = loopStack_shiftPtr[loopStackPtr];
+							currentWord = currCell->genome[wordPtr];
+							// This ensures that the LOOP is rerun //
+							continue;
+						}
+					}
+					break;
+				case 0xb: // TURN: Turn in the direction specified by register //
+					facing = reg & 3;
+					break;
+				case 0xc: // XCHG: Skip next instruction and exchange value of register with it //
+					if ((shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++wordPtr >= MAX_WORDS_GENOME) {
+							wordPtr = EXEC_START_WORD;
+							shiftPtr = EXEC_START_BIT;
+						} else shiftPtr = 0;
+					}
+					tmp = reg;
+					reg = (currCell->genome[wordPtr] >> shiftPtr) & 0xf;
+					currCell->genome[wordPtr] &= ~(((uintptr_t)0xf) << shiftPtr);
+					currCell->genome[wordPtr] |= tmp << shiftPtr;
+					currentWord = currCell->genome[wordPtr];
+					break;
+				case 0xd: // KILL: Blow away neighboring cell if allowed with penalty on failure //
+					neighborCell = getNeighbor(lx,y,facing);
+					if (accessAllowed(neighborCell,reg,0,currRNG)) {
+						if (neighborCell->generation > 2)
+							++statCounters.viableCellsKilled;
+
+						// Filling first two words with 0xfffff... is enough //
+						neighborCell->genome[0] = ~((uintptr_t)0);
+						neighborCell->genome[1] = ~((uintptr_t)0);
+						neighborCell->parentID = 0;
+						neighborCell->generation = 0;
+						nx = (uintptr_t)(neighborCell - cellArray) / POND_SIZE_Y;
+						ny = (uintptr_t)(neighborCell - cellArray) % POND_SIZE_Y;
+						postMessage(nx,ny,MSG_KILL);
+					} else if (neighborCell->generation > 2) {
+						tmp = currCell->energy / FAILED_KILL_PENALTY;
+						if (currCell->energy > tmp)
+							currCell->energy -= tmp;
+						else currCell->energy = 0;
+					}
+					break;
+				case 0xe: // SHARE: Equalize energy between self and neighbor if allowed //
+					neighborCell = getNeighbor(lx,y,facing);
+					if (accessAllowed(neighborCell,reg,1,currRNG)) {
+						if (neighborCell->generation > 2)
+							++statCounters.viableCellShares;
+
+						tmp = currCell->energy + neighborCell->energy;
+						nx = (uintptr_t)(neighborCell - cellArray) / POND_SIZE_Y;
+						ny = (uintptr_t)(neighborCell - cellArray) % POND_SIZE_Y;
+						if ((msg = postMessage(nx,ny,MSG_SHARE)))
+							msg->energyDelta = (int64_t)(tmp / 2) - (int64_t)neighborCell->energy;
+						neighborCell->energy = tmp / 2;
+						currCell->energy = tmp - neighborCell->energy;
+					}
+					break;
+				case 0xf: // STOP: End execution //
+					stop = 1;
+					break;
+			} // end switch
+		} // end else for falseLoopDepth
+
+		if ((shiftPtr += 4) >= BITS_IN_WORD) {
+			if (++wordPtr >= MAX_WORDS_GENOME) {
+				wordPtr = EXEC_START_WORD;
+				shiftPtr = EXEC_START_BIT;
+			} else shiftPtr = 0;
+			currentWord = currCell->genome[wordPtr];
+		} // end if
+	} // end while
+
+	if ((outputBuf[0] & 0xff) != 0xff) {
+		neighborCell = getNeighbor(lx,y,facing);
+		if ((neighborCell->energy)&&accessAllowed(neighborCell,reg,0,currRNG)) {
+			if (neighborCell->generation > 2)
+				++statCounters.viableCellsReplaced;
+
+			neighborCell->parentID = currCell->ID;
+			neighborCell->lineage = currCell->lineage;
+			neighborCell->generation = currCell->generation + 1;
+			for(i=0;i<MAX_WORDS_GENOME;++i)
+				neighborCell->genome[i] = outputBuf[i];
+
+			nx = (uintptr_t)(neighborCell - cellArray) / POND_SIZE_Y;
+			ny = (uintptr_t)(neighborCell - cellArray) % POND_SIZE_Y;
+			if ((msg = postMessage(nx,ny,MSG_OFFSPRING)))
+				msg->cell = *neighborCell;
+		}
+	}
+}
+
+/**
+ * Applies a message from a neighboring rank to the owned cell at column lx.
+ */
+static void applyMessage(const struct HaloMessage *msg, const uintptr_t lx)
+{
+	struct Cell *c = LOCAL_CELL(lx,msg->y);
+	uintptr_t i;
+
+	switch(msg->type) {
+		case MSG_KILL:
+			c->genome[0] = ~((uintptr_t)0);
+			c->genome[1] = ~((uintptr_t)0);
+			c->parentID = 0;
+			c->generation = 0;
+			break;
+		case MSG_SHARE:
+			// The owner may have spent some of this energy since the halo
+			// was sent, so a negative delta is clamped at zero.
+			if ((msg->energyDelta < 0)&&((uintptr_t)(-msg->energyDelta) > c->energy))
+				c->energy = 0;
+			else c->energy += msg->energyDelta;
+			break;
+		case MSG_OFFSPRING:
+			c->parentID = msg->cell.parentID;
+			c->lineage = msg->cell.lineage;
+			c->generation = msg->cell.generation;
+			for(i=0;i<MAX_WORDS_GENOME;++i)
+				c->genome[i] = msg->cell.genome[i];
+			break;
+	}
+}
+
+/**
+ * Sends the outbox for one side and applies what arrives from the other.
+ */
+static void exchangeMessages(const int side)
+{
+	const int dest = side ? rightRank : leftRank;
+	const int source = side ? leftRank : rightRank;
+	// messages sent left land in the receiver's last column and vice versa
+	const uintptr_t targetColumn = side ? 1 : stripWidth;
+	uint64_t sendCount = outboxCount[side], recvCount;
+	size_t i;
+
+	MPI_Sendrecv(&sendCount,1,MPI_UINT64_T,dest,side,
+		&recvCount,1,MPI_UINT64_T,source,side,
+		MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+
+	if (recvCount > inboxSize) {
+		inboxSize = recvCount;
+		free(inbox);
+		inbox = allocOrDie(inboxSize * sizeof(struct HaloMessage),"inbox");
+	}
+
+	MPI_Sendrecv(outbox[side],(int)(sendCount * sizeof(struct HaloMessage)),MPI_BYTE,dest,2 + side,
+		inbox,(int)(recvCount * sizeof(struct HaloMessage)),MPI_BYTE,source,2 + side,
+		MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+
+	for (i = 0; i < recvCount; i++)
+		applyMessage(&inbox[i],targetColumn);
+	outboxCount[side] = 0;
+}
+
+/**
+ * Refreshes both halo columns from the neighboring ranks' boundary columns.
+ */
+static void exchangeHalos()
+{
+	uintptr_t y;
+	int side;
+
+	for (side = 0; side < 2; side++) {
+		// side 0 sends our first column left and fills our right halo
+		const uintptr_t sendColumn = side ? stripWidth : 1;
+		const uintptr_t haloColumn = side ? 0 : stripWidth + 1;
+
+		for (y = 0; y < POND_SIZE_Y; y++) {
+			struct Cell *c = LOCAL_CELL(sendColumn,y);
+			haloSend[y].parentID = c->parentID;
+			haloSend[y].generation = c->generation;
+			haloSend[y].energy = c->energy;
+			haloSend[y].logo = c->genome[0];
+		}
+		MPI_Sendrecv(haloSend,POND_SIZE_Y * sizeof(struct HaloCell),MPI_BYTE,side ? rightRank : leftRank,4 + side,
+			haloRecv,POND_SIZE_Y * sizeof(struct HaloCell),MPI_BYTE,side ? leftRank : rightRank,4 + side,
+			MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+		for (y = 0; y < POND_SIZE_Y; y++) {
+			struct Cell *c = LOCAL_CELL(haloColumn,y);
+			c->parentID = haloRecv[y].parentID;
+			c->generation = haloRecv[y].generation;
+			c->energy = haloRecv[y].energy;
+			c->genome[0] = haloRecv[y].logo;
+		}
+	}
+}
+
+static void initializePond() {
+	uintptr_t lx, y, i;
+
+	stripStart = (uintptr_t)rank * POND_SIZE_X / numRanks;
+	stripWidth = (uintptr_t)(rank + 1) * POND_SIZE_X / numRanks - stripStart;
+	leftRank = (rank + numRanks - 1) % numRanks;
+	rightRank = (rank + 1) % numRanks;
+
+	cellArray = allocOrDie((stripWidth + 2) * POND_SIZE_Y * sizeof(struct Cell),"cellArray");
+	cellPickIndex = (int)(stripWidth * POND_SIZE_Y);
+	rngArray = allocOrDie(((size_t)cellPickIndex + 1) * sizeof(*rngArray),"rngArray");
+	rngIndexArray = allocOrDie(((size_t)cellPickIndex + 1) * sizeof(int),"rngIndexArray");
+	haloSend = allocOrDie(POND_SIZE_Y * sizeof(struct HaloCell),"haloSend");
+	haloRecv = allocOrDie(POND_SIZE_Y * sizeof(struct HaloCell),"haloRecv");
+
+	// Clear pond (including halos) and initialize to blank cells
+	for(lx=0;lx<stripWidth+2;++lx) {
+		for(y=0;y<POND_SIZE_Y;++y) {
+			struct Cell *c = LOCAL_CELL(lx,y);
+			c->ID = 0;
+			c->parentID = 0;
+			c->lineage = 0;
+			c->generation = 0;
+			c->energy = 0;
+			for(i=0;i<MAX_WORDS_GENOME;++i)
+				c->genome[i] = ~((uintptr_t)0);
+		}
+	}
+
+	// Same seed on every rank keeps the replicated cell picker in step
+	init_genrandArray(1234567890);
+	for(i=0;i<1024;++i)
+		getRandomFromArray(cellPickIndex);
+}
+
+//main
+int main(int argc, char **argv)  {
+	uintptr_t i,x,y;
+	struct Cell *currCell;
+	uint64_t clock = 0;
+	uint64_t cellIDCounter = 0;
+	uintptr_t pickX[BATCH_SIZE], pickY[BATCH_SIZE];
+
+	MPI_Init(&argc,&argv);
+	MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+	MPI_Comm_size(MPI_COMM_WORLD,&numRanks);
+	if (numRanks > POND_SIZE_X) {
+		if (!rank)
+			fprintf(stderr,"[ERROR] %d ranks is more than the %d columns of the pond\n",numRanks,POND_SIZE_X);
+		MPI_Abort(MPI_COMM_WORLD,1);
+	}
+
+	double runStart = MPI_Wtime();
+
+	initializePond();
+	if (!rank)
+		fprintf(stderr,"[INFO] %d ranks, %lu columns each (last rank %lu)\n",
+			numRanks,stripWidth,(uintptr_t)POND_SIZE_X - (uintptr_t)(numRanks - 1) * POND_SIZE_X / numRanks);
+
+	// Batch execution loop
+	for (;;) {
+		// Every rank draws the whole batch so the picker stays in step
+		for (i = 0; i < BATCH_SIZE; i++) {
+			pickX[i] = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
+			pickY[i] = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
+		}
+		for (i = 0; i < BATCH_SIZE; i++) {
+			if ((pickX[i] >= stripStart)&&(pickX[i] < stripStart + stripWidth))
+				executeCell(pickX[i] - stripStart + 1,pickY[i]);
+		}
+
+		// Deliver cross-boundary KILL/SHARE/offspring to their owners
+		exchangeMessages(0);
+		exchangeMessages(1);
+
+		clock += BATCH_SIZE;
+
+		// Introduce random cell with energy, applied by the owning rank
+		for (i = 0; i < BATCH_SIZE / INFLOW_FREQUENCY; i++) {
+			uintptr_t energy, genome[MAX_WORDS_GENOME], j;
+
+			x = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
+			y = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
+#ifdef INFLOW_RATE_VARIATION
+			energy = INFLOW_RATE_BASE + (getRandomFromArray(cellPickIndex) % INFLOW_RATE_VARIATION);
+#else
+			energy = INFLOW_RATE_BASE;
+#endif
+			for(j=0;j<MAX_WORDS_GENOME;++j)
+				genome[j] = getRandomFromArray(cellPickIndex);
+
+			if ((x >= stripStart)&&(x < stripStart + stripWidth)) {
+				currCell = LOCAL_CELL(x - stripStart + 1,y);
+				currCell->ID = cellIDCounter;
+				currCell->parentID = 0;
+				currCell->lineage = cellIDCounter;
+				currCell->generation = 0;
+				currCell->energy += energy;
+				for(j=0;j<MAX_WORDS_GENOME;++j)
+					currCell->genome[j] = genome[j];
+			}
+			++cellIDCounter;
+		}
+
+		exchangeHalos();
+
+#ifdef STOP_AT
+		if (clock >= STOP_AT) {
+			double runStop = MPI_Wtime();
+			if (!rank)
+				printf("ranks: %d difference: %lf \n",numRanks,runStop - runStart);
+			break;
+		}
+#endif
+
+		if (!(clock % UPDATE_FREQUENCY))
+			doUpdate(clock);
+		if (!(clock % REPORT_FREQUENCY))
+			doReport(clock);
+	} // end batch execution loop
+
+	MPI_Finalize();
+	return 0;
+}
@@ -4,21 +4,41 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 #ifdef USE_SDL
 #include <SDL.h>
 #endif /* USE_SDL */
 #include <omp.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#ifdef COUNT_LLC_MISSES
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif /* COUNT_LLC_MISSES */
+#ifdef COMPRESS_REPORTS
+#include <zlib.h>
+#endif /* COMPRESS_REPORTS */
+#include "snapshot.h"
+#include "phylogeny.h"
+#include "telemetry.h"
 
 // pond constants
+// POND_SIZE_X, POND_SIZE_Y, MAX_NUM_INSTR, BATCH_SIZE and MUTATION_RATE are
+// only defaults; they can be changed on the command line (run with -h).
 #define STOP_AT 3000000
 #define UPDATE_FREQUENCY 100000
 #define REPORT_FREQUENCY 10000000
 #define CLOCKUPDATE_FREQUENCY 10000
 #define CLOCKREPORT_FREQUENCY 10000000
+#define SNAPSHOT_BUFFER_BYTES (4 << 20)   /* Bytes gathered per snapshot write */
+#define MAX_PENDING_SNAPSHOTS 2         /* Snapshot writers running before reports wait */
+#define KEYFRAME_INTERVAL 10            /* Clock reports per full snapshot; the rest are deltas */
 #define MUTATION_RATE 21475
 #define INFLOW_FREQUENCY 100
 #define INFLOW_RATE_BASE 4000
@@ -30,7 +50,77 @@
 
 #define BATCH_SIZE 100
 
-#define MAX_WORDS_GENOME (MAX_NUM_INSTR / (sizeof(uintptr_t) * 2))
+// Define SPLIT_CELL_LAYOUT (make pe-split) to pad cells to whole cache lines
+// and move ID, lineage and generation out into cellStatsArray.
+//#define SPLIT_CELL_LAYOUT 1
+
+// Define TILED_CELL_LAYOUT (make pe-tiled) to store the pond as 8x8 tiles with
+// cells in Z-order inside each tile, so a cell's four neighbors and most of
+// its colony share a few pages. Every access goes through cellIndex().
+//#define TILED_CELL_LAYOUT 1
+#define TILE_SIDE 8
+
+// Define GENOME_POOL (make pe-pool) to store each distinct genome once, in a
+// shared immutable block, and give cells a pointer to it. Offspring placement
+// is then a hash lookup instead of a copy. Blocks only hold the genome up to
+// its last non-STOP word, so deep genomes (-g up to 65536) need the pool.
+//#define GENOME_POOL 1
+#define GENOME_POOL_LOCKS 1024
+#define GENOME_SLAB_BYTES (1 << 20)
+
+// Define HUGE_PAGES (make pe-huge) to map the pond, RNG and neighbor arrays
+// with MAP_HUGETLB, or failing that ask for transparent huge pages, so random
+// picks stop missing the TLB on nearly every cell.
+//#define HUGE_PAGES 1
+
+// Define INSTRUMENT_VM (make pe-instrument) to count what the VM loop does in
+// per-thread counters: instructions dispatched by opcode, mutations, and log2
+// histograms of instructions run, RNG draws, deepest loop stack and false
+// loop skips. They are reported at each update and at exit. Undefined, every
+// INSTRUMENT() compiles to nothing.
+//#define INSTRUMENT_VM 1
+
+// Cells of the batch are prefetched this many picks ahead of execution, in
+// two stages (see prefetchEarly()); -p 0 turns prefetching off.
+#define PREFETCH_DISTANCE 4
+
+// Side of the square regions that keep their own running totals (see
+// struct StatTile); a multiple of TILE_SIDE.
+#define STAT_TILE_SIDE 32
+
+// Phylogeny log events (-l) each thread buffers before a write, and cell IDs
+// it takes from cellIDCounter at a time
+#define PHYLO_BUFFER_EVENTS 4096
+#define CELL_ID_BLOCK 1024
+
+// Smallest size of the genotype census table, in slots (see maintainCensus())
+#define CENSUS_MIN_SLOTS (1 << 16)
+
+// Define CHECK_POND_STATS to rescan the pond for every stats line and warn if
+// the incrementally kept totals (see noteCell()) have drifted from it.
+//#define CHECK_POND_STATS 1
+
+// Define COMPRESS_REPORTS (make pe-zlib) to deflate report snapshots in
+// independent frames of up to SNAPSHOT_BUFFER_BYTES; -z sets the zlib level.
+//#define COMPRESS_REPORTS 1
+#define REPORT_COMPRESSION 1
+
+// Define COUNT_LLC_MISSES (make pe-llc) to count last-level cache misses of
+// the OpenMP threads with perf_event_open() and log them per cell execution
+// at each update, to compare prefetch distances.
+//#define COUNT_LLC_MISSES 1
+
+// Genome depth accepted on the command line, in instructions
+#define MIN_NUM_INSTR (INSTR_PER_WORD * 2)
+#ifdef GENOME_POOL
+#define MAX_NUM_INSTR_LIMIT 65536
+#else
+#define MAX_NUM_INSTR_LIMIT 16384
+#endif
+#define MAX_WORDS_LIMIT (MAX_NUM_INSTR_LIMIT / INSTR_PER_WORD)
+#define GENOME_CLASSES 13       /* Block size classes of 1, 2, 4 ... 4096 words */
+
+#define INSTR_PER_WORD (sizeof(uintptr_t) * 2)
 #define BITS_IN_WORD (sizeof(uintptr_t) * 8)
 #define N_LEFT 0
 #define N_RIGHT 1
@@ -39,6 +129,45 @@
 #define EXEC_START_WORD 0
 #define EXEC_START_BIT 4
 
+/* Index of a cell, or of a generator in rngArray. Ponds can pass 2^31
+ * cells, so everything that counts or indexes cells uses this type and every
+ * product of pond dimensions goes through geometryMul(). */
+typedef uint64_t cellidx_t;
+
+/**
+ * a * b, stopping with an error that names what was being sized if the
+ * product does not fit in 64 bits
+ */
+static cellidx_t geometryMul(const cellidx_t a,const cellidx_t b,const char *what)
+{
+	cellidx_t product;
+	if (__builtin_mul_overflow(a,b,&product)) {
+		fprintf(stderr,"[ERROR] %s (%lu x %lu) overflows 64 bits.\n",what,a,b);
+		exit(1);
+	}
+	return product;
+}
+
+// Run parameters, set from the command line in main()
+static cellidx_t pondSizeX = POND_SIZE_X;
+static cellidx_t pondSizeY = POND_SIZE_Y;
+static uintptr_t maxNumInstr = MAX_NUM_INSTR;
+static uintptr_t batchSize = BATCH_SIZE;
+static uintptr_t mutationRate = MUTATION_RATE;
+static uintptr_t prefetchDistance = PREFETCH_DISTANCE;
+static uintptr_t clockReportFrequency = CLOCKREPORT_FREQUENCY;
+static uintptr_t keyframeInterval = KEYFRAME_INTERVAL;
+static const char *phyloPath = NULL;    /* Phylogeny log, or none */
+static const char *telemetryName = NULL;        /* Shared memory telemetry segment, or none */
+#ifdef COMPRESS_REPORTS
+static int reportCompression = REPORT_COMPRESSION;
+#else
+static int reportCompression = 0;
+#endif
+static cellidx_t numCells;       /* pondSizeX * pondSizeY */
+static uintptr_t wordsGenome;    /* maxNumInstr / INSTR_PER_WORD */
+static uintptr_t cellStride;     /* Bytes per cell record, CELL_BYTES(wordsGenome) */
+
 // RNG variables; indexes and arrays
 // RNG functions
 #define N 624
@@ -47,13 +176,15 @@
 #define UPPER_MASK 0x80000000UL /* most significant w-r bits */
 #define LOWER_MASK 0x7fffffffUL /* least significant r bits */
 
-static unsigned long rngArray[POND_SIZE_X * POND_SIZE_Y + 1][N];
-static int rngIndexArray[POND_SIZE_X * POND_SIZE_Y + 1];
+/* One generator per cell plus the cell picker; allocated in main() */
+static unsigned long (*rngArray)[N];
+static int *rngIndexArray;
 
 static void init_genrandArray(unsigned long s)
 {
-        int i, j;
-        for (i = 0; i < POND_SIZE_X * POND_SIZE_Y + 1; i++) {
+        cellidx_t i;
+        int j;
+        for (i = 0; i < numCells + 1; i++) {
             //rngArray[i][0] = (s + i) & 0xffffffffUL;
             rngArray[i][0] = (s) & 0xffffffffUL;
             for (j = 1; j < N; j++) {
@@ -62,12 +193,12 @@ static void init_genrandArray(unsigned long s)
                     }      
         } 
 
-        for (j = 0; j < POND_SIZE_X * POND_SIZE_Y + 1; j++) {
-                    rngIndexArray[j] = N;
+        for (i = 0; i < numCells + 1; i++) {
+                    rngIndexArray[i] = N;
                         }
 }
 
-static inline uint32_t genrand_int32Array(int whichRNG) {
+static inline uint32_t genrand_int32Array(const cellidx_t whichRNG) {
         uint32_t y;
             static uint32_t mag01[2]={0x0UL, MATRIX_A};
         if (rngIndexArray[whichRNG] >= N) { /* generate N words at one time */
@@ -97,7 +228,7 @@ static inline uint32_t genrand_int32Array(int whichRNG) {
             return y;
 }
 
-static inline uintptr_t getRandomFromArray(int whichRNG)
+static inline uintptr_t getRandomFromArray(const cellidx_t whichRNG)
 {
     uintptr_t result;
 
@@ -115,16 +246,298 @@ static inline uintptr_t getRandomFromArray(int whichRNG)
 //central structures
 static const uintptr_t BITS_IN_FOURBIT_WORD[16] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
 
+/* Cells are cellStride bytes apart in cellArray, since the genome length is
+ * only known at run time. */
+#ifdef GENOME_POOL
+/* A genome shared by every cell that carries it. Blocks are never written
+ * after internGenome() creates them. Only the first length words are
+ * stored; the rest of the genome is all STOPs (~0). */
+struct Genome {
+	struct Genome *next;    /* Next block in the same hash bucket, or on a free list */
+	struct Genome *nextDead;/* Next block on genomeDeadList */
+	atomic_uintptr_t refs;  /* Number of cells pointing here */
+	atomic_int dead;        /* Set while on genomeDeadList */
+	uint32_t length;        /* Words stored */
+	uint32_t sizeClass;     /* Block holds 1 << sizeClass words */
+	uint64_t hash;
+	uintptr_t words[];
+};
+
+static inline uintptr_t genomeWord(const struct Genome *g,const uintptr_t i)
+{
+	return (i < g->length) ? g->words[i] : ~((uintptr_t)0);
+}
+
+/* Word i of cell c's genome */
+#define GENOME_WORD(c,i) genomeWord(atomic_load_explicit(&(c)->genome,memory_order_acquire),(i))
+#define GENOME_BYTES(words) 0
+#else
+#define GENOME_WORD(c,i) ((c)->genome[i])
+#define GENOME_BYTES(words) ((words) * sizeof(uintptr_t))
+#endif /* GENOME_POOL */
+
+#ifdef SPLIT_CELL_LAYOUT
+/* Fields read on every execution and every neighbor access. The record is
+ * padded to whole cache lines so neighboring cells executed by different
+ * threads never share a line; energy, parentID and the logo share the first. */
+struct Cell {
+	uintptr_t energy;       /* Energy level of this cell */
+	uint64_t parentID;      /* ID of the cell's parent */
+#ifdef GENOME_POOL
+	_Atomic(struct Genome *) genome;/* Shared genome block */
+#else
+	uintptr_t genome[];     /* four-bit instructions packed into machine-size words */
+#endif
+};
+
+#define CELL_BYTES(words) ((sizeof(struct Cell) + GENOME_BYTES(words) + 63) & ~(uintptr_t)63)
+
+/* Statistics fields, kept in a parallel array indexed like cellArray. */
+struct CellStats {
+	uint64_t ID;            /* Globally unique cell ID */
+	uint64_t lineage;       /* Equal to the cell ID of the first cell in the line. */
+	uintptr_t generation;       /* Generations start at 0 and are incremented from there. */
+};
+
+struct CellStats *cellStatsArray;
+
+/* Statistics of cell c, which is at index i in cellArray */
+#define CELL_STATS(c,i) (&cellStatsArray[i])
+#else
 struct Cell {
 	uint64_t ID;            /* Globally unique cell ID */
 	uint64_t parentID;      /* ID of the cell's parent */
 	uint64_t lineage;       /* Equal to the cell ID of the first cell in the line. */
 	uintptr_t generation;       /* Generations start at 0 and are incremented from there. */
 	uintptr_t energy;       /* Energy level of this cell */
-	uintptr_t genome[MAX_WORDS_GENOME];/* four-bit instructions packed into machine-size words */
+#ifdef GENOME_POOL
+	_Atomic(struct Genome *) genome;/* Shared genome block */
+#else
+	uintptr_t genome[];     /* four-bit instructions packed into machine-size words */
+#endif
 };
 
-struct Cell cellArray[POND_SIZE_X][POND_SIZE_Y];
+#define CELL_BYTES(words) (sizeof(struct Cell) + GENOME_BYTES(words))
+
+/* Statistics of cell c, which is at index i in cellArray */
+#define CELL_STATS(c,i) (c)
+#endif /* SPLIT_CELL_LAYOUT */
+
+uint8_t *cellArray;
+
+/* Cell at index i in cellArray. Kernels pass a constant stride. */
+#define CELL(i,stride) ((struct Cell *)(cellArray + (uintptr_t)(i) * (stride)))
+
+/* Hash of the first n words of a genome, used by the genome pool and the
+ * genotype census */
+static inline uint64_t hashGenome(const uintptr_t *words,const uintptr_t n)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	uintptr_t i;
+	for(i=0;i<n;++i) {
+		h = (h ^ (uint64_t)words[i]) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+#ifdef GENOME_POOL
+/* Hash table of every live genome block, chained, with one lock per
+ * GENOME_POOL_LOCKS buckets. Blocks whose count drops to zero go on
+ * genomeDeadList and are only freed by collectGenomes() between batches,
+ * so a cell executing in another thread never sees its genome freed. */
+static struct Genome **genomeBuckets;
+static uintptr_t genomeBucketMask;
+static omp_lock_t genomeLocks[GENOME_POOL_LOCKS];
+static _Atomic(struct Genome *) genomeDeadList;
+static atomic_uintptr_t genomeCount;
+static atomic_uintptr_t genomeBytes;
+
+/* Blocks are carved out of slabs, one free list per power-of-two size
+ * class, so a block costs what its genome uses rather than the full depth. */
+struct GenomeClass {
+	omp_lock_t lock;
+	struct Genome *free;    /* Freed blocks, linked through next */
+	uint8_t *slab;          /* Unused part of the current slab */
+	uintptr_t slabLeft;
+};
+static struct GenomeClass genomeClasses[GENOME_CLASSES];
+
+#define GENOME_CLASS_BYTES(c) (sizeof(struct Genome) + ((uintptr_t)1 << (c)) * sizeof(uintptr_t))
+
+static struct Genome *allocGenome(const uintptr_t n)
+{
+	uint32_t c = 0;
+	struct Genome *g;
+	struct GenomeClass *cl;
+
+	while (((uintptr_t)1 << c) < n)
+		++c;
+	cl = &genomeClasses[c];
+	omp_set_lock(&cl->lock);
+	if ((g = cl->free)) {
+		cl->free = g->next;
+	} else {
+		if (cl->slabLeft < GENOME_CLASS_BYTES(c)) {
+			cl->slabLeft = (GENOME_CLASS_BYTES(c) > GENOME_SLAB_BYTES) ? GENOME_CLASS_BYTES(c) : GENOME_SLAB_BYTES;
+			if (!(cl->slab = malloc(cl->slabLeft))) {
+				fprintf(stderr,"[ERROR] Out of memory in the genome pool.\n");
+				exit(1);
+			}
+		}
+		g = (struct Genome *)cl->slab;
+		cl->slab += GENOME_CLASS_BYTES(c);
+		cl->slabLeft -= GENOME_CLASS_BYTES(c);
+	}
+	omp_unset_lock(&cl->lock);
+	g->sizeClass = c;
+	atomic_fetch_add_explicit(&genomeBytes,GENOME_CLASS_BYTES(c),memory_order_relaxed);
+	return g;
+}
+
+static void freeGenome(struct Genome *g)
+{
+	struct GenomeClass *const cl = &genomeClasses[g->sizeClass];
+	atomic_fetch_sub_explicit(&genomeBytes,GENOME_CLASS_BYTES(g->sizeClass),memory_order_relaxed);
+	omp_set_lock(&cl->lock);
+	g->next = cl->free;
+	cl->free = g;
+	omp_unset_lock(&cl->lock);
+}
+
+static void initializeGenomePool()
+{
+	uintptr_t buckets = 1, i;
+	while (buckets < numCells)
+		buckets <<= 1;
+	genomeBuckets = calloc(buckets,sizeof(*genomeBuckets));
+	if (!genomeBuckets) {
+		fprintf(stderr,"[ERROR] Out of memory allocating the genome pool.\n");
+		exit(1);
+	}
+	genomeBucketMask = buckets - 1;
+	for(i=0;i<GENOME_POOL_LOCKS;++i)
+		omp_init_lock(&genomeLocks[i]);
+	for(i=0;i<GENOME_CLASSES;++i)
+		omp_init_lock(&genomeClasses[i].lock);
+}
+
+/**
+ * Returns the pool's block holding the genome whose first n words are given
+ * (the rest being STOPs) with one more reference, creating it if no cell
+ * carries this genome yet.
+ */
+static struct Genome *internGenome(const uintptr_t *words,uintptr_t n)
+{
+	uint64_t h;
+	uintptr_t bucket;
+	omp_lock_t *lock;
+	struct Genome *g;
+
+	while ((n)&&(words[n-1] == ~((uintptr_t)0)))
+		--n;
+	h = hashGenome(words,n);
+	bucket = h & genomeBucketMask;
+	lock = &genomeLocks[bucket % GENOME_POOL_LOCKS];
+
+	omp_set_lock(lock);
+	for(g=genomeBuckets[bucket];g;g=g->next) {
+		if ((g->hash == h)&&(g->length == n)&&(!memcmp(g->words,words,n * sizeof(uintptr_t)))) {
+			atomic_fetch_add_explicit(&g->refs,1,memory_order_relaxed);
+			omp_unset_lock(lock);
+			return g;
+		}
+	}
+	g = allocGenome(n);
+	memcpy(g->words,words,n * sizeof(uintptr_t));
+	g->length = n;
+	g->hash = h;
+	g->nextDead = NULL;
+	atomic_init(&g->refs,1);
+	atomic_init(&g->dead,0);
+	g->next = genomeBuckets[bucket];
+	genomeBuckets[bucket] = g;
+	omp_unset_lock(lock);
+	atomic_fetch_add_explicit(&genomeCount,1,memory_order_relaxed);
+	return g;
+}
+
+static inline void releaseGenome(struct Genome *g)
+{
+	if ((atomic_fetch_sub_explicit(&g->refs,1,memory_order_acq_rel) == 1)&&(!atomic_exchange(&g->dead,1))) {
+		g->nextDead = atomic_load(&genomeDeadList);
+		while (!atomic_compare_exchange_weak(&genomeDeadList,&g->nextDead,g));
+	}
+}
+
+/**
+ * Points c at g, which the caller holds a reference to, and drops the
+ * reference to c's old genome.
+ */
+static inline void setGenome(struct Cell *c,struct Genome *g)
+{
+	struct Genome *const old = atomic_exchange_explicit(&c->genome,g,memory_order_acq_rel);
+	if (old)
+		releaseGenome(old);
+}
+
+/**
+ * Frees blocks that are still unreferenced. Only called between batches,
+ * while no other thread touches the pool.
+ */
+static void collectGenomes()
+{
+	struct Genome *g = atomic_exchange(&genomeDeadList,NULL), *nextDead, **p;
+	for(;g;g=nextDead) {
+		nextDead = g->nextDead;
+		if (atomic_load(&g->refs)) {
+			atomic_store(&g->dead,0);
+			continue;
+		}
+		for(p=&genomeBuckets[g->hash & genomeBucketMask];*p != g;p=&(*p)->next);
+		*p = g->next;
+		freeGenome(g);
+		atomic_fetch_sub_explicit(&genomeCount,1,memory_order_relaxed);
+	}
+}
+#endif /* GENOME_POOL */
+
+#ifdef TILED_CELL_LAYOUT
+/* Spreads the low three bits of v out to the even bit positions */
+#define SPREAD3(v) (((v) & 1) | (((v) & 2) << 1) | (((v) & 4) << 2))
+/* And gathers them back */
+#define COMPACT3(v) (((v) & 1) | (((v) >> 1) & 2) | (((v) >> 2) & 4))
+#endif /* TILED_CELL_LAYOUT */
+
+/**
+ * Maps pond coordinates to a slot in cellArray. This is the only place that
+ * knows the layout; everything else uses the index or walks cellArray
+ * linearly when order does not matter.
+ */
+static inline cellidx_t cellIndex(const cellidx_t x,const cellidx_t y)
+{
+#ifdef TILED_CELL_LAYOUT
+	const cellidx_t tile = (x / TILE_SIDE) * (pondSizeY / TILE_SIDE) + (y / TILE_SIDE);
+	return tile * (TILE_SIDE * TILE_SIDE) + ((SPREAD3(x % TILE_SIDE) << 1) | SPREAD3(y % TILE_SIDE));
+#else
+	return x * pondSizeY + y;
+#endif
+}
+
+/**
+ * Inverse of cellIndex(): x * pondSizeY + y for cellArray slot i
+ */
+static inline cellidx_t cellPosition(const cellidx_t i)
+{
+#ifdef TILED_CELL_LAYOUT
+	const cellidx_t tile = i / (TILE_SIDE * TILE_SIDE), z = i % (TILE_SIDE * TILE_SIDE);
+	const cellidx_t x = (tile / (pondSizeY / TILE_SIDE)) * TILE_SIDE + COMPACT3(z >> 1);
+	const cellidx_t y = (tile % (pondSizeY / TILE_SIDE)) * TILE_SIDE + COMPACT3(z);
+	return x * pondSizeY + y;
+#else
+	return i;
+#endif
+}
 
 struct PerUpdateStatCounters
 {
@@ -137,31 +550,746 @@ struct PerUpdateStatCounters
 
 struct PerUpdateStatCounters statCounters; 
 
+/* Changes to the pond totals made by one thread since the last update. The
+ * kernel gathers a cell execution's changes on the stack and adds them to its
+ * thread's slot when it finishes; collectPondTotals() folds the slots in. */
+struct PondStatDeltas {
+	int64_t energy;
+	int64_t activeCells;
+	int64_t viableReplicators;
+	uintptr_t maxGeneration;    /* Highest generation a cell became active with */
+	int64_t genotypes;          /* Genotypes gained less genotypes lost */
+	int64_t blankCells;         /* Live cells with an all-STOP genome */
+	double countLogCount;       /* Change in the census sum of count * ln(count) */
+	/* Changes to one stat tile, held back and added to it in one go by
+	 * applyTileDeltas(); the kernel uses this for the executing cell's
+	 * tile. NO_STAT_TILE sends every change straight to its tile. */
+	cellidx_t tile;
+	int64_t tileEnergy;
+	int64_t tileActiveCells;
+	int64_t tileViableReplicators;
+	int tileDirty;
+} __attribute__((aligned(64)));
 
-static void doClockUpdate(const uintptr_t clock)
+#define NO_STAT_TILE (~(cellidx_t)0)
+
+static struct PondStatDeltas *pondStatDeltas;  /* One per OpenMP thread */
+
+/* Each thread's running totals, copied into the telemetry segment */
+struct ThreadTotals {
+	struct TelemetryThread totals;
+} __attribute__((aligned(64)));
+
+static struct ThreadTotals *threadTotals;       /* One per OpenMP thread */
+
+#ifdef INSTRUMENT_VM
+#define INSTRUMENT(...) __VA_ARGS__
+
+/* Buckets of a log2 histogram: 0 holds zero, b holds 2^(b-1) up to 2^b - 1 */
+#define INSTRUMENT_BUCKETS 65
+
+/* What one thread's VM loop did since the last update. The histograms count
+ * executions, except falseLoopSkips, which counts skips. */
+struct VMInstrument {
+	uint64_t executions;
+	uint64_t dispatches[16];        /* Instructions run by the switch, after mutation */
+	uint64_t instructionMutations;
+	uint64_t registerMutations;
+	uint64_t rngDraws;
+	uint64_t maxLoopDepth;
+	uint64_t instructions[INSTRUMENT_BUCKETS];
+	uint64_t draws[INSTRUMENT_BUCKETS];
+	uint64_t loopDepth[INSTRUMENT_BUCKETS];
+	uint64_t falseLoopSkips[INSTRUMENT_BUCKETS];    /* By instructions skipped */
+} __attribute__((aligned(64)));
+
+static struct VMInstrument *vmInstruments;      /* One per OpenMP thread */
+static __thread struct VMInstrument *vmInstrument;      /* This thread's, once it has run a cell */
+static struct VMInstrument vmRunTotals;
+
+static inline unsigned log2Bucket(const uint64_t v)
 {
-	static uint64_t lastTotalViableReplicators = 0;
+	return v ? 64 - __builtin_clzll(v) : 0;
+}
+#else
+#define INSTRUMENT(...)
+#endif
 
-	uintptr_t x,y;
+/* Pond totals as of the last collectPondTotals() */
+static uint64_t pondEnergy, pondActiveCells, pondViableReplicators;
+static uintptr_t pondMaxGeneration;
 
-	uint64_t totalActiveCells = 0;
-	uint64_t totalEnergy = 0;
-	uint64_t totalViableReplicators = 0;
-	uintptr_t maxGeneration = 0;
-  
-	for(x=0;x<POND_SIZE_X;++x) {
-		for(y=0;y<POND_SIZE_Y;++y) {
-			struct Cell *const c = &cellArray[x][y];
+/* Active cells of each generation, so the highest can be found again when
+ * the oldest line dies out. Grown between batches by reserveGenerations(). */
+static _Atomic int64_t *activeByGeneration;
+static uintptr_t generationCapacity;
+
+/* Running totals for one STAT_TILE_SIDE square of the pond. The sums are
+ * kept exact with atomic adds from noteCell(); the highest generation and
+ * the dominant lineage are recomputed from the tile's cells by
+ * refreshStatTile() when asked for after the tile has changed. */
+struct StatTile {
+	_Atomic int64_t energy;
+	_Atomic int64_t activeCells;
+	_Atomic int64_t viableReplicators;
+	atomic_int dirty;           /* maxGeneration and dominantLineage are stale */
+	uintptr_t maxGeneration;
+	uint64_t dominantLineage;   /* Most common lineage among viable replicators */
+	uint64_t dominantCount;     /* Viable replicators of that lineage */
+} __attribute__((aligned(64)));
+
+static struct StatTile *statTiles;      /* statTilesX * statTilesY, column by column */
+static cellidx_t statTilesX, statTilesY;
+
+/**
+ * Stat tile holding cellArray slot i
+ */
+static inline cellidx_t statTileOf(const cellidx_t i)
+{
+#ifdef TILED_CELL_LAYOUT
+	const cellidx_t tile = i / (TILE_SIDE * TILE_SIDE);
+	const cellidx_t x = (tile / (pondSizeY / TILE_SIDE)) * TILE_SIDE;
+	const cellidx_t y = (tile % (pondSizeY / TILE_SIDE)) * TILE_SIDE;
+#else
+	const cellidx_t x = i / pondSizeY;
+	const cellidx_t y = i % pondSizeY;
+#endif
+	return (x / STAT_TILE_SIDE) * statTilesY + (y / STAT_TILE_SIDE);
+}
+
+/* One bit per cellArray slot, set by markDirty() when anything in the cell
+ * is written and cleared by doClockReport() once it has taken a snapshot.
+ * Delta snapshots hold just the cells marked here. */
+static _Atomic uint64_t *dirtyCells;
+
+/**
+ * Marks cellArray slot i as written since the last clock report
+ */
+static inline void markDirty(const cellidx_t i)
+{
+	_Atomic uint64_t *const w = &dirtyCells[i / 64];
+	const uint64_t bit = (uint64_t)1 << (i % 64);
+	/* Busy cells are marked already, so only the first write pays for the locked OR */
+	if (!(atomic_load_explicit(w,memory_order_relaxed) & bit))
+		atomic_fetch_or_explicit(w,bit,memory_order_relaxed);
+}
+
+static inline int isDirty(const cellidx_t i)
+{
+	return (atomic_load_explicit(&dirtyCells[i / 64],memory_order_relaxed) >> (i % 64)) & 1;
+}
+
+/* Live cells of each genotype, a genotype being the hash of a genome up to
+ * its trailing STOP words. Open addressing; slots are claimed with a CAS and
+ * only given up when maintainCensus() rebuilds the table between batches, so
+ * lookups never race a removal. */
+struct CensusSlot {
+	_Atomic uint64_t genotype;  /* 0 while the slot is free */
+	_Atomic int64_t count;
+};
+
+static struct CensusSlot *census;
+static uint64_t censusMask;
+static atomic_uintptr_t censusUsed;     /* Slots claimed, live or not */
+static uint64_t *cellGenotype;          /* Genotype of each cellArray slot, live or not */
+
+/* Census totals as of the last collectPondTotals(): genotypes with live
+ * cells, and the sum over those of count * ln(count) */
+static uint64_t censusGenotypes;
+static double censusCountLogCount;
+
+/* Genotype of an all-STOP genome, as in a cell never written that only
+ * holds energy from a SHARE. Such cells are a good part of any pond but no
+ * species, so the census leaves them out and only counts them here, as of
+ * the last collectPondTotals(). */
+#define EMPTY_GENOTYPE (0xcbf29ce484222325ULL | 1)      /* hashGenome() of nothing */
+static uint64_t censusBlankCells;
+
+/* The genotype that last grew past dominantCount cells. Another takes over
+ * only by growing past it, which keeps finding the leader O(1); doUpdate()
+ * lowers dominantCount to the leader's current count. */
+static _Atomic uint64_t dominantGenotype;
+static _Atomic int64_t dominantCount;
+
+/**
+ * Genotype of a genome n words long. Never 0.
+ */
+static inline uint64_t genotypeOf(const uintptr_t *words,uintptr_t n)
+{
+	while ((n)&&(words[n-1] == ~((uintptr_t)0)))
+		--n;
+	return hashGenome(words,n) | 1;
+}
+
+/**
+ * Genotype of cell c, whose genome is words long
+ */
+static inline uint64_t cellGenotypeOf(struct Cell *const c,const uintptr_t words)
+{
+#ifdef GENOME_POOL
+	/* Pool blocks are already hashed up to their trailing STOPs */
+	return atomic_load_explicit(&c->genome,memory_order_acquire)->hash | 1;
+#else
+	return genotypeOf(c->genome,words);
+#endif
+}
+
+/**
+ * Census slot of a genotype, claiming a free one if it has none
+ */
+static struct CensusSlot *censusSlot(const uint64_t genotype)
+{
+	uint64_t i = genotype & censusMask, seen;
+	for(;;) {
+		seen = atomic_load_explicit(&census[i].genotype,memory_order_relaxed);
+		if (seen == genotype)
+			return &census[i];
+		if (!seen) {
+			if (atomic_compare_exchange_strong_explicit(&census[i].genotype,&seen,genotype,memory_order_relaxed,memory_order_relaxed)) {
+				atomic_fetch_add_explicit(&censusUsed,1,memory_order_relaxed);
+				return &census[i];
+			}
+			continue;   /* Taken meanwhile; look at what took it */
+		}
+		i = (i + 1) & censusMask;
+	}
+}
+
+static inline double xlogx(const int64_t c)
+{
+	return (c > 0) ? (double)c * log((double)c) : 0.0;
+}
+
+/**
+ * Adds n (1 or -1) live cells to a genotype's count, or to the blank cells
+ */
+static inline void countGenotype(struct PondStatDeltas *const d,const uint64_t genotype,const int64_t n)
+{
+	if (genotype == EMPTY_GENOTYPE) {
+		d->blankCells += n;
+		return;
+	}
+	struct CensusSlot *const s = censusSlot(genotype);
+	const int64_t c0 = atomic_fetch_add_explicit(&s->count,n,memory_order_relaxed), c1 = c0 + n;
+	d->genotypes += (c1 > 0) - (c0 > 0);
+	d->countLogCount += xlogx(c1) - xlogx(c0);
+	if (c1 > atomic_load_explicit(&dominantCount,memory_order_relaxed)) {
+		atomic_store_explicit(&dominantCount,c1,memory_order_relaxed);
+		atomic_store_explicit(&dominantGenotype,genotype,memory_order_relaxed);
+	}
+}
+
+/**
+ * Gives cell i a new genotype, moving it across in the census if live. Must
+ * be called whenever a cell's genome changes outside initializePond().
+ */
+static inline void setGenotype(struct PondStatDeltas *const d,const cellidx_t i,const uint64_t genotype,const int live)
+{
+	const uint64_t old = cellGenotype[i];
+	if (old == genotype)
+		return;
+	if (live) {
+		countGenotype(d,old,-1);
+		countGenotype(d,genotype,1);
+	}
+	cellGenotype[i] = genotype;
+}
+
+/* Cell IDs come from cellIDCounter a block at a time, so births in
+ * different threads never contend for it. 0 is no cell. */
+static _Atomic uint64_t cellIDCounter = 1;
+
+/* Each thread's block of cell IDs and its unwritten phylogeny events */
+struct ThreadLineage {
+	uint64_t nextID;
+	uint64_t endID;
+	uintptr_t used;             /* Events waiting in events */
+	struct PhyloEvent *events;  /* PHYLO_BUFFER_EVENTS of them, with -l */
+} __attribute__((aligned(64)));
+
+static struct ThreadLineage *threadLineages;    /* One per OpenMP thread */
+static int phyloFd = -1;        /* Phylogeny log, open for appending, with -l */
+static uintptr_t batchClock;    /* Clock at the start of the running batch */
+
+static inline uint64_t newCellID(struct ThreadLineage *const t)
+{
+	if (t->nextID == t->endID) {
+		t->nextID = atomic_fetch_add_explicit(&cellIDCounter,CELL_ID_BLOCK,memory_order_relaxed);
+		t->endID = t->nextID + CELL_ID_BLOCK;
+	}
+	return t->nextID++;
+}
+
+/**
+ * Appends a thread's buffered events to the phylogeny log. One write() per
+ * buffer, and the log is opened O_APPEND, so threads never split each
+ * other's records.
+ */
+static void flushPhylogeny(struct ThreadLineage *const t)
+{
+	const size_t bytes = t->used * sizeof(struct PhyloEvent);
+	if ((bytes)&&(write(phyloFd,t->events,bytes) != (ssize_t)bytes))
+		fprintf(stderr,"[WARNING] Lost %lu phylogeny events writing %s.\n",(uint64_t)t->used,phyloPath);
+	t->used = 0;
+}
+
+/**
+ * Writes out every thread's buffered phylogeny events. Only between batches.
+ */
+static void flushAllPhylogeny()
+{
+	uintptr_t t;
+	if (phyloFd >= 0)
+		for(t=0;t<omp_get_max_threads();++t)
+			flushPhylogeny(&threadLineages[t]);
+}
+
+/**
+ * Records a birth or the end of cell id, at cellArray slot i, in the
+ * thread's buffer: a few stores, and a write() every PHYLO_BUFFER_EVENTS.
+ * Births must be logged after setGenotype(). Does nothing without -l, or
+ * for ID 0: cells that only ever got energy from a SHARE were never born.
+ */
+static inline void logEvent(struct ThreadLineage *const t,const uint32_t type,const uint64_t id,const uint64_t parentID,const cellidx_t i,const uintptr_t generation)
+{
+	struct PhyloEvent *e;
+	if ((phyloFd < 0)||(!id))
+		return;
+	e = &t->events[t->used];
+	e->clock = batchClock;
+	e->id = id;
+	e->parentID = parentID;
+	e->genotype = (type <= PHYLO_INFLOW) ? cellGenotype[i] : 0;
+	e->position = cellPosition(i);
+	e->type = type;
+	e->generation = generation;
+	if (++t->used == PHYLO_BUFFER_EVENTS)
+		flushPhylogeny(t);
+}
+
+/**
+ * Records that cell i went from energy e0 and generation g0 to e1 and g1,
+ * in the thread's deltas and in the cell's stat tile. Must be called at
+ * every such change outside initializePond(). Also marks the cell dirty, so
+ * callers that change a neighbor need not, and counts it in or out of the
+ * census when it comes alive or dies.
+ */
+static inline void noteCell(struct PondStatDeltas *const d,const cellidx_t i,const uintptr_t e0,const uintptr_t g0,const uintptr_t e1,const uintptr_t g1)
+{
+	const cellidx_t tile = statTileOf(i);
+	struct StatTile *const t = (tile == d->tile) ? NULL : &statTiles[tile];
+	markDirty(i);
+	d->energy += (int64_t)e1 - (int64_t)e0;
+	if (t)
+		atomic_fetch_add_explicit(&t->energy,(int64_t)e1 - (int64_t)e0,memory_order_relaxed);
+	else d->tileEnergy += (int64_t)e1 - (int64_t)e0;
+	if (e0 && e1 && (g0 == g1))
+		return;
+	if (t)
+		atomic_store_explicit(&t->dirty,1,memory_order_relaxed);
+	else d->tileDirty = 1;
+	if ((!e0) != (!e1)) {
+		countGenotype(d,cellGenotype[i],e1 ? 1 : -1);
+		if ((e0)&&(phyloFd >= 0))
+			logEvent(&threadLineages[omp_get_thread_num()],PHYLO_STARVED,CELL_STATS(CELL(i,cellStride),i)->ID,0,i,g0);
+	}
+	if ((e0)&&(g0 < generationCapacity)) {
+		--d->activeCells;
+		d->viableReplicators -= (g0 > 2);
+		atomic_fetch_sub_explicit(&activeByGeneration[g0],1,memory_order_relaxed);
+		if (t) {
+			atomic_fetch_sub_explicit(&t->activeCells,1,memory_order_relaxed);
+			atomic_fetch_sub_explicit(&t->viableReplicators,(g0 > 2),memory_order_relaxed);
+		} else {
+			--d->tileActiveCells;
+			d->tileViableReplicators -= (g0 > 2);
+		}
+	}
+	if ((e1)&&(g1 < generationCapacity)) {
+		++d->activeCells;
+		d->viableReplicators += (g1 > 2);
+		atomic_fetch_add_explicit(&activeByGeneration[g1],1,memory_order_relaxed);
+		if (t) {
+			atomic_fetch_add_explicit(&t->activeCells,1,memory_order_relaxed);
+			atomic_fetch_add_explicit(&t->viableReplicators,(g1 > 2),memory_order_relaxed);
+		} else {
+			++d->tileActiveCells;
+			d->tileViableReplicators += (g1 > 2);
+		}
+		if (g1 > d->maxGeneration)
+			d->maxGeneration = g1;
+	}
+}
+
+/**
+ * Adds the stat tile changes noteCell() held back in d to their tile
+ */
+static inline void applyTileDeltas(struct PondStatDeltas *const d)
+{
+	struct StatTile *const t = &statTiles[d->tile];
+	if (d->tileEnergy)
+		atomic_fetch_add_explicit(&t->energy,d->tileEnergy,memory_order_relaxed);
+	if (d->tileActiveCells)
+		atomic_fetch_add_explicit(&t->activeCells,d->tileActiveCells,memory_order_relaxed);
+	if (d->tileViableReplicators)
+		atomic_fetch_add_explicit(&t->viableReplicators,d->tileViableReplicators,memory_order_relaxed);
+	if (d->tileDirty)
+		atomic_store_explicit(&t->dirty,1,memory_order_relaxed);
+}
+
+static int compareLineage(const void *a,const void *b)
+{
+	const uint64_t la = *(const uint64_t *)a, lb = *(const uint64_t *)b;
+	return (la > lb) - (la < lb);
+}
+
+/**
+ * Recomputes a stat tile's highest generation and dominant lineage from its
+ * cells, if anything that affects them changed since the last time. Only
+ * call between batches.
+ */
+static void refreshStatTile(const cellidx_t t)
+{
+	static uint64_t lineages[STAT_TILE_SIDE * STAT_TILE_SIDE];
+	struct StatTile *const tile = &statTiles[t];
+	const cellidx_t x0 = (t / statTilesY) * STAT_TILE_SIDE;
+	const cellidx_t y0 = (t % statTilesY) * STAT_TILE_SIDE;
+	cellidx_t x, y, self;
+	uintptr_t n = 0, i, run;
+
+	if (!atomic_load_explicit(&tile->dirty,memory_order_relaxed))
+		return;
+	tile->maxGeneration = 0;
+	for(x=x0;(x<x0 + STAT_TILE_SIDE)&&(x<pondSizeX);++x) {
+		for(y=y0;(y<y0 + STAT_TILE_SIDE)&&(y<pondSizeY);++y) {
+			self = cellIndex(x,y);
+			struct Cell *const c = CELL(self,cellStride);
 			if (c->energy) {
-				++totalActiveCells;
-				totalEnergy += (uint64_t)c->energy;
-				if (c->generation > 2)
-					++totalViableReplicators;
-				if (c->generation > maxGeneration)
-					maxGeneration = c->generation;
+				if (CELL_STATS(c,self)->generation > 2)
+					lineages[n++] = CELL_STATS(c,self)->lineage;
+				if (CELL_STATS(c,self)->generation > tile->maxGeneration)
+					tile->maxGeneration = CELL_STATS(c,self)->generation;
 			}
 		}
 	}
+
+	qsort(lineages,n,sizeof(*lineages),compareLineage);
+	tile->dominantLineage = 0;
+	tile->dominantCount = 0;
+	for(i=0;i<n;i+=run) {
+		for(run=1;(i + run < n)&&(lineages[i + run] == lineages[i]);++run);
+		if (run > tile->dominantCount) {
+			tile->dominantLineage = lineages[i];
+			tile->dominantCount = run;
+		}
+	}
+	atomic_store_explicit(&tile->dirty,0,memory_order_relaxed);
+}
+
+/* Totals over a rectangle of stat tiles */
+struct RegionStats {
+	uint64_t energy;
+	uint64_t activeCells;
+	uint64_t viableReplicators;
+	uintptr_t maxGeneration;
+	uint64_t dominantLineage;   /* Dominant lineage of the tile where it is most numerous */
+	uint64_t dominantCount;
+	cellidx_t deadTiles;        /* Tiles without an active cell */
+};
+
+/**
+ * Reduces the stat tiles covering cells [x0,x1) x [y0,y1), rounded out to
+ * whole tiles, without visiting any cell of a tile that has not changed.
+ * The lineage figures are only looked up when withLineage is set, since
+ * that refreshes the changed tiles. Only call between batches.
+ */
+static void regionStats(const cellidx_t x0,const cellidx_t y0,const cellidx_t x1,const cellidx_t y1,const int withLineage,struct RegionStats *const r)
+{
+	cellidx_t tx, ty, t;
+	memset(r,0,sizeof(*r));
+	for(tx=x0 / STAT_TILE_SIDE;tx<(x1 + STAT_TILE_SIDE - 1) / STAT_TILE_SIDE;++tx) {
+		for(ty=y0 / STAT_TILE_SIDE;ty<(y1 + STAT_TILE_SIDE - 1) / STAT_TILE_SIDE;++ty) {
+			t = tx * statTilesY + ty;
+			r->energy += atomic_load_explicit(&statTiles[t].energy,memory_order_relaxed);
+			r->activeCells += atomic_load_explicit(&statTiles[t].activeCells,memory_order_relaxed);
+			r->viableReplicators += atomic_load_explicit(&statTiles[t].viableReplicators,memory_order_relaxed);
+			r->deadTiles += !atomic_load_explicit(&statTiles[t].activeCells,memory_order_relaxed);
+			if (withLineage) {
+				refreshStatTile(t);
+				if (statTiles[t].maxGeneration > r->maxGeneration)
+					r->maxGeneration = statTiles[t].maxGeneration;
+				if (statTiles[t].dominantCount > r->dominantCount) {
+					r->dominantLineage = statTiles[t].dominantLineage;
+					r->dominantCount = statTiles[t].dominantCount;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Makes room in activeByGeneration for every generation the next batch can
+ * reach. Each cell execution adds at most one generation to the deepest
+ * line, so batchSize past the deepest so far is enough. Called after every
+ * batch, before collectPondTotals() clears the slots it reads.
+ */
+static void reserveGenerations()
+{
+	static uintptr_t deepest = 0;
+	uintptr_t needed, t;
+
+	for(t=0;t<omp_get_max_threads();++t)
+		if (pondStatDeltas[t].maxGeneration > deepest)
+			deepest = pondStatDeltas[t].maxGeneration;
+	needed = deepest + batchSize + 1;
+	if (needed <= generationCapacity)
+		return;
+
+	needed *= 2;
+	activeByGeneration = realloc(activeByGeneration,needed * sizeof(*activeByGeneration));
+	if (!activeByGeneration) {
+		fprintf(stderr,"[ERROR] Out of memory counting %lu generations.\n",needed);
+		exit(1);
+	}
+	for(t=generationCapacity;t<needed;++t)
+		atomic_init(&activeByGeneration[t],0);
+	generationCapacity = needed;
+}
+
+/**
+ * Between batches, makes sure the census has room for the genotypes another
+ * batch can add (each cell execution can bring three, and inflow some more).
+ * If not, rebuilds it with only the live genotypes, at a size that leaves
+ * them at most a quarter of the slots. Rebuilding also recomputes the census
+ * totals, dropping whatever rounding the running sums have gathered.
+ */
+static void maintainCensus()
+{
+	const uint64_t room = 4 * batchSize;
+	struct CensusSlot *const old = census;
+	const uint64_t oldSlots = old ? censusMask + 1 : 0;
+	uint64_t slots = CENSUS_MIN_SLOTS, live = 0, i;
+	int64_t c;
+
+	if ((old)&&(atomic_load(&censusUsed) + room <= oldSlots / 2))
+		return;
+	for(i=0;i<oldSlots;++i)
+		live += (atomic_load_explicit(&old[i].count,memory_order_relaxed) > 0);
+	while (slots < 4 * (live + room))
+		slots <<= 1;
+	if (!(census = calloc(slots,sizeof(*census)))) {
+		fprintf(stderr,"[ERROR] Out of memory allocating a census of %lu genotypes.\n",slots);
+		exit(1);
+	}
+	censusMask = slots - 1;
+	atomic_store(&censusUsed,0);
+	censusGenotypes = 0;
+	censusCountLogCount = 0.0;
+	for(i=0;i<oldSlots;++i) {
+		if ((c = atomic_load_explicit(&old[i].count,memory_order_relaxed)) > 0) {
+			atomic_store_explicit(&censusSlot(atomic_load_explicit(&old[i].genotype,memory_order_relaxed))->count,c,memory_order_relaxed);
+			++censusGenotypes;
+			censusCountLogCount += xlogx(c);
+		}
+	}
+	free(old);
+	for(i=0;i<omp_get_max_threads();++i) {
+		pondStatDeltas[i].genotypes = 0;
+		pondStatDeltas[i].countLogCount = 0.0;
+	}
+}
+
+/**
+ * Folds every thread's deltas into the pond totals and returns them. Costs
+ * O(threads) plus however far the highest generation fell since last time.
+ */
+static void collectPondTotals(uint64_t *energy,uint64_t *activeCells,uint64_t *viableReplicators,uintptr_t *maxGeneration)
+{
+	uintptr_t t;
+	for(t=0;t<omp_get_max_threads();++t) {
+		struct PondStatDeltas *const d = &pondStatDeltas[t];
+		pondEnergy += d->energy;
+		pondActiveCells += d->activeCells;
+		pondViableReplicators += d->viableReplicators;
+		if (d->maxGeneration > pondMaxGeneration)
+			pondMaxGeneration = d->maxGeneration;
+		censusGenotypes += d->genotypes;
+		censusCountLogCount += d->countLogCount;
+		censusBlankCells += d->blankCells;
+		d->energy = d->activeCells = d->viableReplicators = d->genotypes = d->blankCells = 0;
+		d->maxGeneration = 0;
+		d->countLogCount = 0.0;
+	}
+	while ((pondMaxGeneration)&&(!atomic_load_explicit(&activeByGeneration[pondMaxGeneration],memory_order_relaxed)))
+		--pondMaxGeneration;
+
+#ifdef CHECK_POND_STATS
+	{
+		uint64_t e = 0, a = 0, v = 0;
+		uintptr_t g = 0;
+		cellidx_t x;
+		for(x=0;x<numCells;++x) {
+			struct Cell *const c = CELL(x,cellStride);
+			if (c->energy) {
+				++a;
+				e += (uint64_t)c->energy;
+				if (CELL_STATS(c,x)->generation > 2)
+					++v;
+				if (CELL_STATS(c,x)->generation > g)
+					g = CELL_STATS(c,x)->generation;
+			}
+		}
+		if ((e != pondEnergy)||(a != pondActiveCells)||(v != pondViableReplicators)||(g != pondMaxGeneration))
+			fprintf(stderr,"[WARNING] Pond totals drifted: energy %lu/%lu, active %lu/%lu, viable %lu/%lu, max generation %lu/%lu (kept/scanned).\n",
+				pondEnergy,e,pondActiveCells,a,pondViableReplicators,v,(uint64_t)pondMaxGeneration,(uint64_t)g);
+
+		struct RegionStats r;
+		regionStats(0,0,pondSizeX,pondSizeY,1,&r);
+		if ((e != r.energy)||(a != r.activeCells)||(v != r.viableReplicators)||(g != r.maxGeneration))
+			fprintf(stderr,"[WARNING] Stat tiles drifted: energy %lu/%lu, active %lu/%lu, viable %lu/%lu, max generation %lu/%lu (tiles/scanned).\n",
+				r.energy,e,r.activeCells,a,r.viableReplicators,v,(uint64_t)r.maxGeneration,(uint64_t)g);
+
+		uint64_t counted = 0, kinds = 0;
+		for(x=0;x<=censusMask;++x) {
+			const int64_t c = atomic_load_explicit(&census[x].count,memory_order_relaxed);
+			counted += (c > 0) ? c : 0;
+			kinds += (c > 0);
+		}
+		if ((counted + censusBlankCells != a)||(kinds != censusGenotypes))
+			fprintf(stderr,"[WARNING] Census drifted: %lu/%lu live cells in %lu/%lu genotypes (census and blank/scanned, kept).\n",
+				counted + censusBlankCells,a,kinds,censusGenotypes);
+	}
+#endif
+
+	*energy = pondEnergy;
+	*activeCells = pondActiveCells;
+	*viableReplicators = pondViableReplicators;
+	*maxGeneration = pondMaxGeneration;
+}
+
+#ifdef COUNT_LLC_MISSES
+/* One hardware counter per OpenMP thread, -1 where it could not be opened */
+static int *llcFd;
+static int llcCounters;         /* Number opened */
+
+/**
+ * Opens a cache-miss counter on each OpenMP thread. Counters follow the
+ * thread that opened them, and OpenMP keeps its threads for the whole run.
+ */
+static void openLLCCounters()
+{
+	int t;
+	llcFd = malloc(omp_get_max_threads() * sizeof(*llcFd));
+#pragma omp parallel
+	{
+		struct perf_event_attr attr;
+		memset(&attr,0,sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		llcFd[omp_get_thread_num()] = (int)syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+	}
+	for(t=0;t<omp_get_max_threads();++t)
+		llcCounters += (llcFd[t] >= 0);
+	if (llcCounters < omp_get_max_threads())
+		fprintf(stderr,"[WARNING] LLC miss counter available on %d of %d threads.\n",llcCounters,omp_get_max_threads());
+}
+
+static uint64_t readLLCMisses()
+{
+	uint64_t total = 0, count;
+	int t;
+	for(t=0;t<omp_get_max_threads();++t)
+		if ((llcFd[t] >= 0)&&(read(llcFd[t],&count,sizeof(count)) == sizeof(count)))
+			total += count;
+	return total;
+}
+#endif
+
+
+#ifdef INSTRUMENT_VM
+static const char *const INSTRUCTION_NAMES[16] = {
+	"ZERO","FWD","BACK","INC","DEC","READG","WRITEG","READB",
+	"WRITEB","LOOP","REP","TURN","XCHG","KILL","SHARE","STOP"
+};
+
+/**
+ * Prints the non-empty buckets of a log2 histogram, each by its lowest value
+ */
+static void printHistogram(const char *what,const uint64_t *h,const char *tail)
+{
+	unsigned b;
+	fprintf(stderr,"[INFO] %s:",what);
+	for(b=0;b<INSTRUMENT_BUCKETS;++b)
+		if (h[b])
+			fprintf(stderr,b ? " %lu+:%lu" : " %lu:%lu",b ? 1UL << (b - 1) : 0UL,h[b]);
+	fprintf(stderr,"%s\n",tail);
+}
+
+static void printInstruments(const char *when,const struct VMInstrument *v)
+{
+	char tail[64];
+	unsigned x;
+	fprintf(stderr,"[INFO] VM %s: %lu executions, %lu instruction and %lu register mutations; dispatched",
+		when,v->executions,v->instructionMutations,v->registerMutations);
+	for(x=0;x<16;++x)
+		fprintf(stderr,"%s %s %lu",x ? "," : "",INSTRUCTION_NAMES[x],v->dispatches[x]);
+	fprintf(stderr,"\n");
+	printHistogram("VM instructions per execution",v->instructions,"");
+	snprintf(tail,sizeof(tail)," (%lu in all)",v->rngDraws);
+	printHistogram("VM RNG draws per execution",v->draws,tail);
+	snprintf(tail,sizeof(tail)," (deepest %lu)",v->maxLoopDepth);
+	printHistogram("VM deepest loop stack per execution",v->loopDepth,tail);
+	printHistogram("VM instructions skipped per false loop",v->falseLoopSkips,"");
+}
+
+static void addInstruments(struct VMInstrument *const to,const struct VMInstrument *const from)
+{
+	unsigned b;
+	to->executions += from->executions;
+	for(b=0;b<16;++b)
+		to->dispatches[b] += from->dispatches[b];
+	to->instructionMutations += from->instructionMutations;
+	to->registerMutations += from->registerMutations;
+	to->rngDraws += from->rngDraws;
+	if (from->maxLoopDepth > to->maxLoopDepth)
+		to->maxLoopDepth = from->maxLoopDepth;
+	for(b=0;b<INSTRUMENT_BUCKETS;++b) {
+		to->instructions[b] += from->instructions[b];
+		to->draws[b] += from->draws[b];
+		to->loopDepth[b] += from->loopDepth[b];
+		to->falseLoopSkips[b] += from->falseLoopSkips[b];
+	}
+}
+
+/**
+ * Prints what the VM did since the last update, adds it to the run totals
+ * and clears the per-thread counters. Only between batches.
+ */
+static void reportInstruments()
+{
+	struct VMInstrument sum;
+	uintptr_t t;
+	memset(&sum,0,sizeof(sum));
+	for(t=0;t<omp_get_max_threads();++t)
+		addInstruments(&sum,&vmInstruments[t]);
+	memset(vmInstruments,0,omp_get_max_threads() * sizeof(*vmInstruments));
+	printInstruments("since the last update",&sum);
+	addInstruments(&vmRunTotals,&sum);
+}
+#endif
+
+static void doClockUpdate(const uintptr_t clock)
+{
+	static uint64_t lastTotalViableReplicators = 0;
+
+	cellidx_t x;
+
+	uint64_t totalActiveCells, totalEnergy, totalViableReplicators;
+	uintptr_t maxGeneration;
+	collectPondTotals(&totalEnergy,&totalActiveCells,&totalViableReplicators,&maxGeneration);
   
 	/* Look here to get the columns in the CSV output */
 	/* The first five are here and are self-explanatory */
@@ -211,27 +1339,12 @@ static void doClockUpdate(const uintptr_t clock)
 static void doUpdate(const uintptr_t clock)
 {
 	static uint64_t lastTotalViableReplicators = 0;
-
-	uintptr_t x,y;
-
-	uint64_t totalActiveCells = 0;
-	uint64_t totalEnergy = 0;
-	uint64_t totalViableReplicators = 0;
-	uintptr_t maxGeneration = 0;
-  
-	for(x=0;x<POND_SIZE_X;++x) {
-		for(y=0;y<POND_SIZE_Y;++y) {
-			struct Cell *const c = &cellArray[x][y];
-			if (c->energy) {
-				++totalActiveCells;
-				totalEnergy += (uint64_t)c->energy;
-				if (c->generation > 2)
-					++totalViableReplicators;
-				if (c->generation > maxGeneration)
-					maxGeneration = c->generation;
-			}
-		}
-	}
+
+	cellidx_t x;
+
+	uint64_t totalActiveCells, totalEnergy, totalViableReplicators;
+	uintptr_t maxGeneration;
+	collectPondTotals(&totalEnergy,&totalActiveCells,&totalViableReplicators,&maxGeneration);
   
 	/* Look here to get the columns in the CSV output */
 	/* The first five are here and are self-explanatory */
@@ -272,172 +1385,513 @@ static void doUpdate(const uintptr_t clock)
 			fprintf(stderr,"[EVENT] Viable replicators have appeared!\n");
   
 	lastTotalViableReplicators = totalViableReplicators;
+#ifdef GENOME_POOL
+	fprintf(stderr,"[INFO] Genome pool holds %lu distinct genomes (%lu KiB)\n",
+		(uint64_t)atomic_load(&genomeCount),
+		(uint64_t)atomic_load(&genomeBytes) / 1024);
+#endif
+	{
+		/* Where the energy is, from the stat tiles alone */
+		struct RegionStats r;
+		cellidx_t t, densest = 0;
+		for(t=1;t<statTilesX * statTilesY;++t)
+			if (atomic_load_explicit(&statTiles[t].energy,memory_order_relaxed) >
+				atomic_load_explicit(&statTiles[densest].energy,memory_order_relaxed))
+				densest = t;
+		regionStats(0,0,pondSizeX,pondSizeY,0,&r);
+		refreshStatTile(densest);
+		fprintf(stderr,"[INFO] %lu of %lu stat tiles dead; densest at (%lu,%lu) with %ld energy, %ld active, dominant lineage %lu (%lu viable)\n",
+			r.deadTiles,statTilesX * statTilesY,
+			(densest / statTilesY) * STAT_TILE_SIDE,(densest % statTilesY) * STAT_TILE_SIDE,
+			(int64_t)atomic_load(&statTiles[densest].energy),(int64_t)atomic_load(&statTiles[densest].activeCells),
+			statTiles[densest].dominantLineage,statTiles[densest].dominantCount);
+	}
+	{
+		/* Genotype census, from its running totals; blank cells are no genotype */
+		const double n = (double)(totalActiveCells - censusBlankCells);
+		const uint64_t leader = atomic_load(&dominantGenotype);
+		const int64_t leaderCount = leader ? atomic_load(&censusSlot(leader)->count) : 0;
+		atomic_store(&dominantCount,leaderCount);
+		fprintf(stderr,"[INFO] %lu genotypes among %lu live cells with a genome (%lu blank); dominant %016lx is %.2f%%; Shannon diversity %.3f\n",
+			censusGenotypes,totalActiveCells - censusBlankCells,censusBlankCells,leader,
+			(n > 0) ? 100.0 * (double)leaderCount / n : 0.0,
+			(n > 0) ? log(n) - censusCountLogCount / n : 0.0);
+	}
+#ifdef COUNT_LLC_MISSES
+	if (llcCounters) {
+		static uint64_t lastMisses = 0, lastClock = 0;
+		const uint64_t misses = readLLCMisses();
+		fprintf(stderr,"[INFO] %.2f LLC misses per cell execution (prefetch distance %lu)\n",
+			(double)(misses - lastMisses) / (double)(clock - lastClock),prefetchDistance);
+		lastMisses = misses;
+		lastClock = clock;
+	}
+#endif
+#ifdef INSTRUMENT_VM
+	reportInstruments();
+#endif
+  
+	/* Keep the phylogeny log on disk no more than an update behind */
+	flushAllPhylogeny();
   
 	/* Reset per-update stat counters */
 	for(x=0;x<sizeof(statCounters);++x)
 		((uint8_t *)&statCounters)[x] = (uint8_t)0;
 }
 
-static void doClockReport(const uintptr_t clock)
+/**
+ * Copies all wordsGenome words of cell c's genome to dst
+ */
+static inline void copyGenome(uintptr_t *const dst,struct Cell *const c)
+{
+#ifdef GENOME_POOL
+	const struct Genome *const g = atomic_load_explicit(&c->genome,memory_order_acquire);
+	memcpy(dst,g->words,g->length * sizeof(uintptr_t));
+	memset(dst + g->length,0xff,(wordsGenome - g->length) * sizeof(uintptr_t));
+#else
+	memcpy(dst,c->genome,wordsGenome * sizeof(uintptr_t));
+#endif
+}
+
+/**
+ * Value of one snapshot column for the cell at position x * pondSizeY + y
+ */
+static uint64_t snapshotField(const cellidx_t position,const int column)
 {
-	char buf[MAX_NUM_INSTR*2];
+	const cellidx_t self = cellIndex(position / pondSizeY,position % pondSizeY);
+	struct Cell *const c = CELL(self,cellStride);
+	switch(column) {
+		case SNAPSHOT_POSITION: return position;
+		case SNAPSHOT_ID: return CELL_STATS(c,self)->ID;
+		case SNAPSHOT_PARENT_ID: return c->parentID;
+		case SNAPSHOT_LINEAGE: return CELL_STATS(c,self)->lineage;
+		case SNAPSHOT_GENERATION: return CELL_STATS(c,self)->generation;
+		case SNAPSHOT_ENERGY: return c->energy;
+	}
+	return 0;
+}
+
+/* Where writeSnapshot() sends the body of a snapshot, and how much went */
+struct SnapshotOut {
 	FILE *d;
-	uintptr_t x,y,wordPtr,shiftPtr,inst,stopCount,i;
-	struct Cell *currCell;
-  
-	sprintf(buf,"c%lu.report.csv",clock);
-	d = fopen(buf,"w");
-	if (!d) {
-		fprintf(stderr,"[WARNING] Could not open %s for writing.\n",buf);
+	uint8_t *packed;        /* Room for one deflated buffer */
+	uint64_t rawBytes;
+	uint64_t fileBytes;
+	int failed;
+};
+
+/**
+ * Writes the next bytes of a snapshot body, as a frame of their own if the
+ * report is compressed
+ */
+static void putSnapshotBlock(struct SnapshotOut *const o,const void *const p,const size_t bytes)
+{
+#ifdef COMPRESS_REPORTS
+	if (reportCompression) {
+		struct SnapshotFrame f;
+		uLongf packedBytes = compressBound(SNAPSHOT_BUFFER_BYTES);
+		o->failed |= (compress2(o->packed,&packedBytes,p,bytes,reportCompression) != Z_OK);
+		f.rawBytes = bytes;
+		f.packedBytes = packedBytes;
+		o->failed |= (fwrite(&f,sizeof(f),1,o->d) != 1);
+		o->failed |= (fwrite(o->packed,1,packedBytes,o->d) != packedBytes);
+		o->rawBytes += bytes;
+		o->fileBytes += sizeof(f) + packedBytes;
 		return;
 	}
-  
-	fprintf(stderr,"[INFO] Reporting viable cells to %s\n",buf);
-  
-	for(x=0;x<POND_SIZE_X;++x) {
-		for(y=0;y<POND_SIZE_Y;++y) {
-			currCell = &cellArray[x][y];
-			//if (currCell->energy&&(currCell->generation > 2)) {
-				fprintf(d,"ID: %lu, parent ID: %lu, lineage: %lu, generation: %lu\n",
-					(uint64_t)currCell->ID,
-					(uint64_t)currCell->parentID,
-					(uint64_t)currCell->lineage,
-					(uint64_t)currCell->generation);
-				wordPtr = 0;
-				shiftPtr = 0;
-				stopCount = 0;
-				for(i=0;i<MAX_NUM_INSTR;++i) {
-					inst = (currCell->genome[wordPtr] >> shiftPtr) & 0xf;
-					/* Four STOP instructions in a row is considered the end.
-					* The probability of this being wrong is *very* small, and
-					* could only occur if you had four STOPs in a row inside
-					* a LOOP/REP pair that's always false. In any case, this
-					* would always result in our *underestimating* the size of
-					* the genome and would never result in an overestimation. */
-					fprintf(d,"%lx",inst);
-					if (inst == 0xf) { /* STOP */
-						if (++stopCount >= 4)
-							break;
-					} else 
-						stopCount = 0;
-					
-					if ((shiftPtr += 4) >= BITS_IN_WORD) {
-						if (++wordPtr >= MAX_WORDS_GENOME) {
-							wordPtr = 0;
-							shiftPtr = 4;
-						} else 
-							shiftPtr = 0;
-					}
-				}
-			//}
+#endif
+	o->failed |= (fwrite(p,1,bytes,o->d) != bytes);
+	o->rawBytes += bytes;
+	o->fileBytes += bytes;
+}
+
+/**
+ * Writes the pond to the file name as a snapshot (see snapshot.h). flags
+ * picks the cells: with SNAPSHOT_VIABLE_ONLY just those with energy past
+ * generation 2, with SNAPSHOT_DELTA just those marked in dirtyCells since
+ * the snapshot at baseClock, otherwise all of them. Columns are
+ * gathered into a buffer and written SNAPSHOT_BUFFER_BYTES at a time, so
+ * this costs about as much as the disk (or zlib) takes to swallow it; the
+ * rate is logged so the compression level can be matched to the report
+ * interval. snaptext turns a snapshot back into the old text report.
+ * Returns nonzero if the file could not be written in full.
+ */
+static int writeSnapshot(const char *const name,const uintptr_t clock,const uint32_t flags,const uintptr_t baseClock)
+{
+	struct SnapshotHeader h;
+	struct SnapshotOut o = {0};
+	struct timeval start, stop;
+	double seconds;
+	cellidx_t *positions, n = 0, x, y, i, j, end, block, self;
+	uint8_t *buffer;
+	struct Cell *c;
+	int k;
+
+	gettimeofday(&start,NULL);
+	positions = malloc(geometryMul(numCells,sizeof(cellidx_t),"Snapshot index"));
+	buffer = malloc(SNAPSHOT_BUFFER_BYTES);
+#ifdef COMPRESS_REPORTS
+	o.packed = malloc(compressBound(SNAPSHOT_BUFFER_BYTES));
+	o.d = (positions && buffer && o.packed) ? fopen(name,"wb") : NULL;
+#else
+	o.d = (positions && buffer) ? fopen(name,"wb") : NULL;
+#endif
+	if (!o.d) {
+		fprintf(stderr,"[WARNING] Could not open %s for writing.\n",name);
+		free(positions);
+		free(buffer);
+		free(o.packed);
+		return 1;
+	}
+
+	for(x=0;x<pondSizeX;++x) {
+		for(y=0;y<pondSizeY;++y) {
+			self = cellIndex(x,y);
+			c = CELL(self,cellStride);
+			if ((flags & SNAPSHOT_VIABLE_ONLY)&&!(c->energy&&(CELL_STATS(c,self)->generation > 2)))
+				continue;
+			if ((flags & SNAPSHOT_DELTA)&&!isDirty(self))
+				continue;
+			positions[n++] = x * pondSizeY + y;
+		}
+	}
+
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,SNAPSHOT_MAGIC,sizeof(h.magic));
+	h.version = SNAPSHOT_VERSION;
+	h.byteOrder = SNAPSHOT_BYTE_ORDER;
+	h.headerBytes = sizeof(h);
+	h.flags = flags | (reportCompression ? SNAPSHOT_COMPRESSED : 0);
+	h.clock = clock;
+	h.pondSizeX = pondSizeX;
+	h.pondSizeY = pondSizeY;
+	h.cellCount = n;
+	h.maxNumInstr = maxNumInstr;
+	h.wordsGenome = wordsGenome;
+	h.wordBytes = sizeof(uintptr_t);
+	h.baseClock = baseClock;
+	o.failed |= (fwrite(&h,sizeof(h),1,o.d) != 1);
+	o.fileBytes += sizeof(h);
+
+	block = SNAPSHOT_BUFFER_BYTES / sizeof(uint64_t);
+	for(k=0;k<SNAPSHOT_COLUMNS;++k) {
+		for(i=0;i<n;i=end) {
+			end = (n - i > block) ? i + block : n;
+			for(j=i;j<end;++j)
+				((uint64_t *)buffer)[j - i] = snapshotField(positions[j],k);
+			putSnapshotBlock(&o,buffer,(end - i) * sizeof(uint64_t));
+		}
+	}
+
+	block = SNAPSHOT_BUFFER_BYTES / (wordsGenome * sizeof(uintptr_t));
+	for(i=0;i<n;i=end) {
+		end = (n - i > block) ? i + block : n;
+		for(j=i;j<end;++j) {
+			self = cellIndex(positions[j] / pondSizeY,positions[j] % pondSizeY);
+			copyGenome((uintptr_t *)buffer + (j - i) * wordsGenome,CELL(self,cellStride));
 		}
+		putSnapshotBlock(&o,buffer,(end - i) * wordsGenome * sizeof(uintptr_t));
 	}
+
+	o.failed |= (fclose(o.d) != 0);
+	gettimeofday(&stop,NULL);
+	seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1000000.0;
+	if (o.failed)
+		fprintf(stderr,"[WARNING] Could not write all of %s.\n",name);
+	else if (reportCompression)
+		fprintf(stderr,"[INFO] Wrote %s: %.1f MiB deflated to %.1f MiB (%.1fx) in %.2f s, %.0f MiB/s\n",
+			name,o.rawBytes / 1048576.0,o.fileBytes / 1048576.0,(double)o.rawBytes / (double)o.fileBytes,
+			seconds,o.rawBytes / 1048576.0 / seconds);
+	else
+		fprintf(stderr,"[INFO] Wrote %s: %.1f MiB in %.2f s, %.0f MiB/s\n",
+			name,o.fileBytes / 1048576.0,seconds,o.fileBytes / 1048576.0 / seconds);
+	free(positions);
+	free(buffer);
+	free(o.packed);
+	return o.failed;
 }
-static void doReport(const uintptr_t clock)
+
+/* Orders census slot indexes by count, largest first */
+static int compareCensusCount(const void *a,const void *b)
 {
-	char buf[MAX_NUM_INSTR*2];
+	const int64_t ca = atomic_load_explicit(&census[*(const uint64_t *)a].count,memory_order_relaxed);
+	const int64_t cb = atomic_load_explicit(&census[*(const uint64_t *)b].count,memory_order_relaxed);
+	return (cb > ca) - (cb < ca);
+}
+
+/**
+ * Writes the census as a species table, most common genotype first, each
+ * with the genome of one of its cells in the old reports' hex. Blank cells
+ * are not in the census, so not in the table either. Returns
+ * nonzero if the file could not be written in full.
+ */
+static int writeSpecies(const uintptr_t clock)
+{
+	static char text[MAX_NUM_INSTR_LIMIT];
+	char buf[64];
 	FILE *d;
-	uintptr_t x,y,wordPtr,shiftPtr,inst,stopCount,i;
-	struct Cell *currCell;
-  
-	sprintf(buf,"p%lu.report.csv",clock);
-	d = fopen(buf,"w");
+	cellidx_t *example, x, y, self;
+	uint64_t *order, n = 0, live = 0, i;
+	uintptr_t wordPtr, shiftPtr, inst, stopCount, j;
+	int64_t count;
+	int failed;
+
+	sprintf(buf,"p%lu.species.csv",clock);
+	example = malloc((censusMask + 1) * sizeof(*example));
+	order = malloc((censusMask + 1) * sizeof(*order));
+	d = (example && order) ? fopen(buf,"w") : NULL;
 	if (!d) {
 		fprintf(stderr,"[WARNING] Could not open %s for writing.\n",buf);
-		return;
+		free(example);
+		free(order);
+		return 1;
 	}
-  
-	fprintf(stderr,"[INFO] Reporting viable cells to %s\n",buf);
-  
-	for(x=0;x<POND_SIZE_X;++x) {
-		for(y=0;y<POND_SIZE_Y;++y) {
-			currCell = &cellArray[x][y];
-			if (currCell->energy&&(currCell->generation > 2)) {
-				fprintf(d,"ID: %lu, parent ID: %lu, lineage: %lu, generation: %lu\n",
-					(uint64_t)currCell->ID,
-					(uint64_t)currCell->parentID,
-					(uint64_t)currCell->lineage,
-					(uint64_t)currCell->generation);
-				wordPtr = 0;
-				shiftPtr = 0;
-				stopCount = 0;
-				for(i=0;i<MAX_NUM_INSTR;++i) {
-					inst = (currCell->genome[wordPtr] >> shiftPtr) & 0xf;
-					/* Four STOP instructions in a row is considered the end.
-					* The probability of this being wrong is *very* small, and
-					* could only occur if you had four STOPs in a row inside
-					* a LOOP/REP pair that's always false. In any case, this
-					* would always result in our *underestimating* the size of
-					* the genome and would never result in an overestimation. */
-					fprintf(d,"%lx",inst);
-					if (inst == 0xf) { /* STOP */
-						if (++stopCount >= 4)
-							break;
-					} else 
-						stopCount = 0;
-					
-					if ((shiftPtr += 4) >= BITS_IN_WORD) {
-						if (++wordPtr >= MAX_WORDS_GENOME) {
-							wordPtr = 0;
-							shiftPtr = 4;
-						} else 
-							shiftPtr = 0;
-					}
+
+	for(i=0;i<=censusMask;++i) {
+		example[i] = numCells;
+		if ((count = atomic_load_explicit(&census[i].count,memory_order_relaxed)) > 0) {
+			order[n++] = i;
+			live += count;
+		}
+	}
+	for(x=0;x<pondSizeX;++x) {
+		for(y=0;y<pondSizeY;++y) {
+			self = cellIndex(x,y);
+			if ((CELL(self,cellStride)->energy)&&(cellGenotype[self] != EMPTY_GENOTYPE)) {
+				i = censusSlot(cellGenotype[self]) - census;
+				if (example[i] == numCells)
+					example[i] = self;
+			}
+		}
+	}
+	qsort(order,n,sizeof(*order),compareCensusCount);
+
+	fprintf(stderr,"[INFO] Reporting %lu genotypes to %s\n",n,buf);
+	fprintf(d,"genotype,cells,share,genome\n");
+	for(i=0;i<n;++i) {
+		count = atomic_load_explicit(&census[order[i]].count,memory_order_relaxed);
+		fprintf(d,"%016lx,%ld,%.6f,",(uint64_t)census[order[i]].genotype,count,(double)count / (double)live);
+		if ((self = example[order[i]]) < numCells) {
+			wordPtr = shiftPtr = stopCount = 0;
+			for(j=0;j<maxNumInstr;) {
+				inst = (GENOME_WORD(CELL(self,cellStride),wordPtr) >> shiftPtr) & 0xf;
+				text[j++] = "0123456789abcdef"[inst];
+				/* Four STOPs in a row end the genome, as in the old reports */
+				if ((inst == 0xf)&&(++stopCount >= 4))
+					break;
+				if (inst != 0xf)
+					stopCount = 0;
+				if ((shiftPtr += 4) >= BITS_IN_WORD) {
+					shiftPtr = 0;
+					if (++wordPtr >= wordsGenome)
+						break;
 				}
 			}
+			fwrite(text,1,j,d);
+		}
+		fputc('\n',d);
+	}
+	failed = (fclose(d) != 0);
+	if (failed)
+		fprintf(stderr,"[WARNING] Could not write all of %s.\n",buf);
+	free(example);
+	free(order);
+	return failed;
+}
+
+/* Children of startSnapshot() that may still be writing, oldest first */
+static pid_t snapshotWriters[MAX_PENDING_SNAPSHOTS];
+static int pendingSnapshots = 0;
+
+/**
+ * Reaps snapshot writers that have finished, then waits for the oldest
+ * until at most keep are left running.
+ */
+static void waitForSnapshots(const int keep)
+{
+	int i = 0, status;
+	pid_t pid;
+	while (i < pendingSnapshots) {
+		pid = waitpid(snapshotWriters[i],&status,(pendingSnapshots > keep) ? 0 : WNOHANG);
+		if (pid == 0) {
+			++i;
+			continue;
+		}
+		if ((pid < 0)||(!WIFEXITED(status))||(WEXITSTATUS(status)))
+			fprintf(stderr,"[WARNING] Snapshot writer %d failed.\n",(int)snapshotWriters[i]);
+		memmove(&snapshotWriters[i],&snapshotWriters[i + 1],(--pendingSnapshots - i) * sizeof(pid_t));
+	}
+}
+
+/**
+ * Writes a snapshot of the pond as it is now without holding up the
+ * simulation: a forked child inherits the pond copy-on-write and writes it
+ * while we go on. If MAX_PENDING_SNAPSHOTS writers are already busy, this
+ * waits for the oldest first, so reports the disk cannot keep up with slow
+ * the run down rather than pile up. (Under HUGE_PAGES with MAP_HUGETLB, each
+ * page the parent then writes needs a spare huge page for the copy.) With
+ * species set the child writes the species table too, scanning the pond
+ * for it there rather than here.
+ */
+static void startSnapshot(const char *const name,const uintptr_t clock,const uint32_t flags,const uintptr_t baseClock,const int species)
+{
+	pid_t pid;
+	int failed;
+	if (pendingSnapshots >= MAX_PENDING_SNAPSHOTS)
+		fprintf(stderr,"[INFO] Waiting for a snapshot writer before %s\n",name);
+	waitForSnapshots(MAX_PENDING_SNAPSHOTS - 1);
+
+	pid = fork();
+	if (pid < 0)
+		fprintf(stderr,"[WARNING] Could not fork a snapshot writer; writing %s now.\n",name);
+	if (pid <= 0) {
+		failed = writeSnapshot(name,clock,flags,baseClock);
+		if (species)
+			failed |= writeSpecies(clock);
+		if (pid == 0)
+			_exit(failed);
+		return;
+	}
+	snapshotWriters[pendingSnapshots++] = pid;
+}
+
+/**
+ * Writes every keyframeInterval-th clock report in full and the rest as
+ * deltas of the cells written since the report before, then starts marking
+ * cells afresh.
+ */
+static void doClockReport(const uintptr_t clock)
+{
+	static uintptr_t reports = 0, lastClock = 0;
+	char buf[64];
+	sprintf(buf,"c%lu.report.snap",clock);
+	if (reports++ % keyframeInterval) {
+		fprintf(stderr,"[INFO] Reporting cells changed since clock %lu to %s\n",lastClock,buf);
+		startSnapshot(buf,clock,SNAPSHOT_DELTA,lastClock,0);
+	} else {
+		fprintf(stderr,"[INFO] Reporting all cells to %s\n",buf);
+		startSnapshot(buf,clock,0,0,0);
+	}
+	memset(dirtyCells,0,((numCells + 63) / 64) * sizeof(*dirtyCells));
+	lastClock = clock;
+}
+
+static void doReport(const uintptr_t clock)
+{
+	char buf[64];
+	sprintf(buf,"p%lu.report.snap",clock);
+	fprintf(stderr,"[INFO] Reporting viable cells to %s\n",buf);
+	startSnapshot(buf,clock,SNAPSHOT_VIABLE_ONLY,0,1);
+}
+
+/* Offset in cells from each cell to its neighbor in each direction, with the
+ * toroidal wrap already applied. Filled in by initializeNeighbors(). */
+static int64_t (*neighborOffset)[4];
+
+/**
+ * Computes neighborOffset for the current cellIndex() layout. Space is
+ * toroidal; it wraps at edges.
+ */
+static void initializeNeighbors()
+{
+	cellidx_t x,y,self;
+	for(x=0;x<pondSizeX;++x) {
+		for(y=0;y<pondSizeY;++y) {
+			self = cellIndex(x,y);
+			neighborOffset[self][N_LEFT] = (int64_t)cellIndex((x) ? x-1 : pondSizeX-1,y) - (int64_t)self;
+			neighborOffset[self][N_RIGHT] = (int64_t)cellIndex((x < (pondSizeX-1)) ? x+1 : 0,y) - (int64_t)self;
+			neighborOffset[self][N_UP] = (int64_t)cellIndex(x,(y) ? y-1 : pondSizeY-1) - (int64_t)self;
+			neighborOffset[self][N_DOWN] = (int64_t)cellIndex(x,(y < (pondSizeY-1)) ? y+1 : 0) - (int64_t)self;
 		}
 	}
 }
 
 /**
- * Get a neighbor in the cellArray
+ * Get the index of a neighbor in the cellArray
  */
-static inline struct Cell *getNeighbor(const uintptr_t x,const uintptr_t y,const uintptr_t dir)
+static inline cellidx_t getNeighbor(const cellidx_t self,const uintptr_t dir)
 {
-	/* Space is toroidal; it wraps at edges */
-	switch(dir) {
-		case N_LEFT: 	return (x) ? &cellArray[x-1][y] : &cellArray[POND_SIZE_X-1][y];
-		case N_RIGHT: 	return (x < (POND_SIZE_X-1)) ? &cellArray[x+1][y] : &cellArray[0][y];
-		case N_UP: 	return (y) ? &cellArray[x][y-1] : &cellArray[x][POND_SIZE_Y-1];
-		case N_DOWN: 	return (y < (POND_SIZE_Y-1)) ? &cellArray[x][y+1] : &cellArray[x][0];
-	} 
-	return &cellArray[x][y]; /* This should never be reached */
+	return self + neighborOffset[self][dir & 3];
 }
 
 /**
  * Determines if c1 is allowed to access c2
  */
-static inline int accessAllowed(struct Cell *const c2,const uintptr_t c1guess,int sense, int currRNG)
+static inline int accessAllowed(struct Cell *const c2,const uintptr_t c1guess,int sense, const cellidx_t currRNG)
 {
 	/* Access permission is more probable if they are more similar in sense 0,
 	* and more probable if they are different in sense 1. Sense 0 is used for
 	* "negative" interactions and sense 1 for "positive" ones. */
 	return sense 
 		? (((getRandomFromArray(currRNG) & 0xf) >= 
-			BITS_IN_FOURBIT_WORD[(c2->genome[0] & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID)) 
+			BITS_IN_FOURBIT_WORD[(GENOME_WORD(c2,0) & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID)) 
 		: (((getRandomFromArray(currRNG) & 0xf) <= 
-			BITS_IN_FOURBIT_WORD[(c2->genome[0] & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID));
+			BITS_IN_FOURBIT_WORD[(GENOME_WORD(c2,0) & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID));
+}
+
+
+
+#ifdef GENOME_POOL
+/**
+ * KILL for pooled genomes: c gets a copy of its genome with the first two
+ * words blanked, which is enough to make it inert.
+ */
+static inline void killGenome(struct Cell *c)
+{
+	const struct Genome *const g = atomic_load_explicit(&c->genome,memory_order_acquire);
+	uintptr_t buf[MAX_WORDS_LIMIT];
+	if (g->length <= 2) {
+		setGenome(c,internGenome(buf,0));
+		return;
+	}
+	memcpy(buf,g->words,g->length * sizeof(uintptr_t));
+	buf[0] = ~((uintptr_t)0);
+	buf[1] = ~((uintptr_t)0);
+	setGenome(c,internGenome(buf,g->length));
 }
 
+/* Word i of the genome being executed; past genomeLength it is all STOPs */
+#define GENOME_AT(i) (((i) < genomeLength) ? genome[i] : ~((uintptr_t)0))
 
+/* The executing cell's genome is shared, so it gets a private copy in
+ * workGenome before the first WRITEG or XCHG, extended with STOPs far
+ * enough to hold word i. */
+#define OWN_GENOME(i) do { \
+		if (genome != workGenome) \
+			genome = memcpy(workGenome,genome,genomeLength * sizeof(uintptr_t)); \
+		while (genomeLength <= (i)) \
+			workGenome[genomeLength++] = ~((uintptr_t)0); \
+	} while (0)
+#else
+#define GENOME_AT(i) (genome[i])
+#define OWN_GENOME(i)
+#endif /* GENOME_POOL */
+
+/* Word i of the output buffer; only the first outputLength are written */
+#define OUTPUT_AT(i) (((i) < outputLength) ? outputBuf[i] : ~((uintptr_t)0))
+
+/* Per-thread LOOP stack, allocated on first use and sized for maxNumInstr */
+static __thread uintptr_t *loopStack;
 
 //array of locations where the threads can go to get the location of a random cell
-unsigned long randomLocationX[BATCH_SIZE];
-unsigned long randomLocationY[BATCH_SIZE];
+cellidx_t *randomLocationX;
+cellidx_t *randomLocationY;
+
+cellidx_t cellPickIndex;
 
-int cellConflicts[POND_SIZE_X][POND_SIZE_Y];
-int cellPickIndex = POND_SIZE_X * POND_SIZE_Y;
+/* v modulo size, as a mask when the pond sides are powers of two */
+#define WRAP(v,size,pow2) ((pow2) ? ((v) & ((size) - 1)) : ((v) % (size)))
 
-void pickBatch() {
-        int i;
-for (i = 0; i < BATCH_SIZE; i++) {     
-        int x = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
-        int y = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
+static inline __attribute__((always_inline)) void pickBatchKernel(const int pow2) {
+        uintptr_t i;
+for (i = 0; i < batchSize; i++) {     
+        cellidx_t x = WRAP(getRandomFromArray(cellPickIndex), pondSizeX, pow2);
+        cellidx_t y = WRAP(getRandomFromArray(cellPickIndex), pondSizeY, pow2);
 	
       //if (clock - BATCH_SIZE > 0) { 	
         //while (!cellArray[x][y].energy) {	//make sure cell doesn't conflict and has energy 
-                x = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
-                y = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
+                x = WRAP(getRandomFromArray(cellPickIndex), pondSizeX, pow2);
+                y = WRAP(getRandomFromArray(cellPickIndex), pondSizeY, pow2);
         //}    
       //}
 
@@ -448,16 +1902,27 @@ for (i = 0; i < BATCH_SIZE; i++) {
         }    
 }
 
-int executeCell(int x, int y) {
-	if (!cellArray[x][y].energy) {
+/**
+ * Executes the cell at (x,y). words is the genome length in machine words;
+ * the instances below pass a constant so the genome loops and the cell
+ * stride are fixed at compile time.
+ */
+static inline __attribute__((always_inline)) int executeCellKernel(const cellidx_t x, const cellidx_t y, const uintptr_t words) {
+	const uintptr_t stride = CELL_BYTES(words);
+	const cellidx_t self = cellIndex(x,y);
+	if (!CELL(self,stride)->energy) {
                 return 0;
         }
 
 	uintptr_t ptr_wordPtr = 0; 
     	uintptr_t ptr_shiftPtr = 0; 
     	uintptr_t reg = 0; 
-    	uintptr_t loopStack_wordPtr[MAX_NUM_INSTR];
-  	uintptr_t loopStack_shiftPtr[MAX_NUM_INSTR];
+	if ((!loopStack)&&(!(loopStack = malloc(2 * words * INSTR_PER_WORD * sizeof(uintptr_t))))) {
+		fprintf(stderr,"[ERROR] Out of memory allocating a loop stack.\n");
+		exit(1);
+	}
+    	uintptr_t *const loopStack_wordPtr = loopStack;
+  	uintptr_t *const loopStack_shiftPtr = loopStack + words * INSTR_PER_WORD;
 	uintptr_t loopStackPtr = 0; 
     	uintptr_t wordPtr = EXEC_START_WORD;
     	uintptr_t shiftPtr = EXEC_START_BIT;
@@ -466,40 +1931,63 @@ int executeCell(int x, int y) {
     	int stop = 0; 		
 	uintptr_t currentWord; 
 	uintptr_t inst, tmp;
-	struct Cell *currCell = &cellArray[x][y];
-	struct Cell *neighborCell = getNeighbor(x, y, facing); 
+	struct Cell *currCell = CELL(self,stride);
+	uintptr_t neighbor = getNeighbor(self, facing);
+	struct Cell *neighborCell = CELL(neighbor,stride); 
 		
-	int currRNG = x + POND_SIZE_X * y;
-	currentWord = currCell->genome[0];
+	const cellidx_t currRNG = x + pondSizeX * y;
+#ifdef GENOME_POOL
+	uintptr_t workGenome[MAX_WORDS_LIMIT];
+	struct Genome *const block = atomic_load_explicit(&currCell->genome,memory_order_acquire);
+	uintptr_t *genome = block->words;
+	uintptr_t genomeLength = block->length;
+#else
+	uintptr_t *genome = currCell->genome;
+#endif
+	currentWord = GENOME_AT(0);
 		
 	int i;
-	uintptr_t outputBuf[MAX_WORDS_GENOME];
-	for(i=0;i<MAX_WORDS_GENOME;++i)
-      		outputBuf[i] = ~((uintptr_t)0);
+	uintptr_t outputBuf[MAX_WORDS_LIMIT];
+	uintptr_t outputLength = 0;
 	uint64_t instrExecs[16] = {0}; 
+	struct PondStatDeltas delta = { .tile = statTileOf(self) };
+	int rewritten = 0;      /* WRITEG or XCHG changed our own genome */
         uint64_t cellsReplaced = 0; 
         uint64_t cellsKilled = 0; 
         uint64_t cellsShared = 0; 
+	INSTRUMENT(
+	uint64_t rngDraws = 0, deepest = 0, skipped = 0;
+	if (!vmInstrument)
+		vmInstrument = &vmInstruments[omp_get_thread_num()];
+	)
 		
     while (currCell->energy&&(!stop)) {
       inst = (currentWord >> shiftPtr) & 0xf;
       instrExecs[inst] += 1.0;
 
-      if ((getRandomFromArray(currRNG) & 0xffffffff) < MUTATION_RATE) {
+      if ((getRandomFromArray(currRNG) & 0xffffffff) < mutationRate) {
         tmp = getRandomFromArray(currRNG); 
         if (tmp & 0x80) // Check for the 8th bit to get random boolean //
           inst = tmp & 0xf; // Only the first four bits are used here //
         else reg = tmp & 0xf;
+        INSTRUMENT(++rngDraws; ++*((tmp & 0x80) ? &vmInstrument->instructionMutations : &vmInstrument->registerMutations);)
       }
       
       --currCell->energy;
+      if (currCell->energy) {
+        --delta.energy;
+        --delta.tileEnergy;
+      } else noteCell(&delta,self,1,CELL_STATS(currCell,self)->generation,0,CELL_STATS(currCell,self)->generation);
       
       if (falseLoopDepth) {
+        INSTRUMENT(++skipped;)
         if (inst == 0x9)
           ++falseLoopDepth;
         else if (inst == 0xa) 
           --falseLoopDepth;
+        INSTRUMENT(if (!falseLoopDepth) { ++vmInstrument->falseLoopSkips[log2Bucket(skipped)]; skipped = 0; })
       } else {
+        INSTRUMENT(++vmInstrument->dispatches[inst];)
         switch(inst) { 
           case 0x0: // ZERO: Zero VM state registers //
             reg = 0;
@@ -509,7 +1997,7 @@ int executeCell(int x, int y) {
             break;
           case 0x1: // FWD: Increment the pointer (wrap at end) //
             if ((ptr_shiftPtr += 4) >= BITS_IN_WORD) {
-              if (++ptr_wordPtr >= MAX_WORDS_GENOME)
+              if (++ptr_wordPtr >= words)
                 ptr_wordPtr = 0;
               ptr_shiftPtr = 0;
             }
@@ -520,7 +2008,7 @@ int executeCell(int x, int y) {
             else {
               if (ptr_wordPtr)
                 --ptr_wordPtr;
-              else ptr_wordPtr = MAX_WORDS_GENOME - 1;
+              else ptr_wordPtr = words - 1;
               ptr_shiftPtr = BITS_IN_WORD - 4;
             }
             break;
@@ -531,28 +2019,33 @@ int executeCell(int x, int y) {
             reg = (reg - 1) & 0xf;
             break;
           case 0x5: // READG: Read into the register from genome //
-            reg = (currCell->genome[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+            reg = (GENOME_AT(ptr_wordPtr) >> ptr_shiftPtr) & 0xf;
             break;
           case 0x6: // WRITEG: Write out from the register to genome //
-            currCell->genome[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
-            currCell->genome[ptr_wordPtr] |= reg << ptr_shiftPtr;
-            currentWord = currCell->genome[wordPtr]; // Must refresh in case this changed! //
+            OWN_GENOME(ptr_wordPtr);
+            genome[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+            genome[ptr_wordPtr] |= reg << ptr_shiftPtr;
+            rewritten = 1;
+            currentWord = GENOME_AT(wordPtr); // Must refresh in case this changed! //
             break;
           case 0x7: // READB: Read into the register from buffer //
-            reg = (outputBuf[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+            reg = (OUTPUT_AT(ptr_wordPtr) >> ptr_shiftPtr) & 0xf;
             break;
           case 0x8: // WRITEB: Write out from the register to buffer //
+            while (outputLength <= ptr_wordPtr)
+              outputBuf[outputLength++] = ~((uintptr_t)0);
             outputBuf[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
             outputBuf[ptr_wordPtr] |= reg << ptr_shiftPtr;
             break;
           case 0x9: // LOOP: Jump forward to matching REP if register is zero //
             if (reg) {
-              if (loopStackPtr >= MAX_NUM_INSTR)
+              if (loopStackPtr >= words * INSTR_PER_WORD)
                 stop = 1; // Stack overflow ends execution //
               else {
                 loopStack_wordPtr[loopStackPtr] = wordPtr;
                 loopStack_shiftPtr[loopStackPtr] = shiftPtr;
                 ++loopStackPtr;
+                INSTRUMENT(if (loopStackPtr > deepest) deepest = loopStackPtr;)
               }
             } else falseLoopDepth = 1;
             break;
@@ -562,7 +2055,7 @@ int executeCell(int x, int y) {
               if (reg) {
                 wordPtr = loopStack_wordPtr[loopStackPtr];
                 shiftPtr = loopStack_shiftPtr[loopStackPtr];
-                currentWord = currCell->genome[wordPtr];
+                currentWord = GENOME_AT(wordPtr);
                 // This ensures that the LOOP is rerun //
                 continue;
               }
@@ -573,47 +2066,69 @@ int executeCell(int x, int y) {
             break;
           case 0xc: // XCHG: Skip next instruction and exchange value of register with it //
             if ((shiftPtr += 4) >= BITS_IN_WORD) {
-              if (++wordPtr >= MAX_WORDS_GENOME) {
+              if (++wordPtr >= words) {
                 wordPtr = EXEC_START_WORD;
                 shiftPtr = EXEC_START_BIT;
               } else shiftPtr = 0;
             }
             tmp = reg;
-            reg = (currCell->genome[wordPtr] >> shiftPtr) & 0xf;
-            currCell->genome[wordPtr] &= ~(((uintptr_t)0xf) << shiftPtr);
-            currCell->genome[wordPtr] |= tmp << shiftPtr;
-            currentWord = currCell->genome[wordPtr];
+            reg = (GENOME_AT(wordPtr) >> shiftPtr) & 0xf;
+            OWN_GENOME(wordPtr);
+            genome[wordPtr] &= ~(((uintptr_t)0xf) << shiftPtr);
+            genome[wordPtr] |= tmp << shiftPtr;
+            rewritten = 1;
+            currentWord = genome[wordPtr];
             break;
           case 0xd: // KILL: Blow away neighboring cell if allowed with penalty on failure //
-            neighborCell = getNeighbor(x,y,facing);
+            neighbor = getNeighbor(self,facing);
+            neighborCell = CELL(neighbor,stride);
+            INSTRUMENT(++rngDraws;)
             if (accessAllowed(neighborCell,reg,0,currRNG)) {
-              if (neighborCell->generation > 2)
+              if (CELL_STATS(neighborCell,neighbor)->generation > 2)
                 ++cellsKilled;
+              const uint64_t genotype0 = cellGenotype[neighbor];
 
               // Filling first two words with 0xfffff... is enough //
+#ifdef GENOME_POOL
+              killGenome(neighborCell);
+#else
               neighborCell->genome[0] = ~((uintptr_t)0);
               neighborCell->genome[1] = ~((uintptr_t)0);
+#endif
+              setGenotype(&delta,neighbor,cellGenotypeOf(neighborCell,words),neighborCell->energy != 0);
+              // Killing an already blank or starved cell ends nothing //
+              if ((neighborCell->energy)&&(cellGenotype[neighbor] != genotype0))
+                logEvent(&threadLineages[omp_get_thread_num()],PHYLO_KILLED,CELL_STATS(neighborCell,neighbor)->ID,0,
+                  neighbor,CELL_STATS(neighborCell,neighbor)->generation);
               //neighborCell->ID = cellIDCounter;
               neighborCell->parentID = 0;
               //neighborCell->lineage = cellIDCounter;
-              neighborCell->generation = 0;
+              noteCell(&delta,neighbor,neighborCell->energy,CELL_STATS(neighborCell,neighbor)->generation,neighborCell->energy,0);
+              CELL_STATS(neighborCell,neighbor)->generation = 0;
               //++cellIDCounter;
-            } else if (neighborCell->generation > 2) {
+            } else if (CELL_STATS(neighborCell,neighbor)->generation > 2) {
+              const uintptr_t e0 = currCell->energy;
               tmp = currCell->energy / FAILED_KILL_PENALTY;
               if (currCell->energy > tmp)
                 currCell->energy -= tmp;
               else currCell->energy = 0;
+              noteCell(&delta,self,e0,CELL_STATS(currCell,self)->generation,currCell->energy,CELL_STATS(currCell,self)->generation);
             }
             break;
           case 0xe: // SHARE: Equalize energy between self and neighbor if allowed //
-            neighborCell = getNeighbor(x,y,facing);
+            neighbor = getNeighbor(self,facing);
+            neighborCell = CELL(neighbor,stride);
+            INSTRUMENT(++rngDraws;)
             if (accessAllowed(neighborCell,reg,1,currRNG)) {
-              if (neighborCell->generation > 2)
+              if (CELL_STATS(neighborCell,neighbor)->generation > 2)
                 ++cellsShared;
 
+              const uintptr_t e0 = currCell->energy, n0 = neighborCell->energy;
               tmp = currCell->energy + neighborCell->energy;
               neighborCell->energy = tmp / 2;
               currCell->energy = tmp - neighborCell->energy;
+              noteCell(&delta,self,e0,CELL_STATS(currCell,self)->generation,currCell->energy,CELL_STATS(currCell,self)->generation);
+              noteCell(&delta,neighbor,n0,CELL_STATS(neighborCell,neighbor)->generation,neighborCell->energy,CELL_STATS(neighborCell,neighbor)->generation);
             }
             break;
           case 0xf: // STOP: End execution //
@@ -623,54 +2138,186 @@ int executeCell(int x, int y) {
       } // end else for falseLoopDepth
       
       if ((shiftPtr += 4) >= BITS_IN_WORD) {
-        if (++wordPtr >= MAX_WORDS_GENOME) {
+        if (++wordPtr >= words) {
           wordPtr = EXEC_START_WORD;
           shiftPtr = EXEC_START_BIT;
         } else shiftPtr = 0;
-        currentWord = currCell->genome[wordPtr];
+        currentWord = GENOME_AT(wordPtr);
       } // end if
     } // end while
 
-   if ((outputBuf[0] & 0xff) != 0xff) {
+#ifdef GENOME_POOL
+   if (genome == workGenome)
+        setGenome(currCell,internGenome(workGenome,genomeLength));
+#endif
+   if (rewritten)
+        setGenotype(&delta,self,cellGenotypeOf(currCell,words),currCell->energy != 0);
+
+   if ((OUTPUT_AT(0) & 0xff) != 0xff) {
+        INSTRUMENT(rngDraws += (neighborCell->energy != 0);)
         if ((neighborCell->energy)&&accessAllowed(neighborCell,reg,0,currRNG)) {
-        	if (neighborCell->generation > 2)
+        	if (CELL_STATS(neighborCell,neighbor)->generation > 2)
           		++cellsReplaced;
 
-        	//neighborCell->ID = ++cellIDCounter;
-        	neighborCell->parentID = currCell->ID;
-        	neighborCell->lineage = currCell->lineage; 
-        	neighborCell->generation = currCell->generation + 1;
-        	for(i=0;i<MAX_WORDS_GENOME;++i)
-          		neighborCell->genome[i] = outputBuf[i];
+        	struct ThreadLineage *const t = &threadLineages[omp_get_thread_num()];
+        	logEvent(t,PHYLO_REPLACED,CELL_STATS(neighborCell,neighbor)->ID,0,neighbor,CELL_STATS(neighborCell,neighbor)->generation);
+        	++threadTotals[omp_get_thread_num()].totals.offspring;
+        	CELL_STATS(neighborCell,neighbor)->ID = newCellID(t);
+        	neighborCell->parentID = CELL_STATS(currCell,self)->ID;
+        	CELL_STATS(neighborCell,neighbor)->lineage = CELL_STATS(currCell,self)->lineage; 
+        	noteCell(&delta,neighbor,neighborCell->energy,CELL_STATS(neighborCell,neighbor)->generation,
+        		neighborCell->energy,CELL_STATS(currCell,self)->generation + 1);
+        	CELL_STATS(neighborCell,neighbor)->generation = CELL_STATS(currCell,self)->generation + 1;
+        	atomic_store_explicit(&statTiles[statTileOf(neighbor)].dirty,1,memory_order_relaxed);
+#ifdef GENOME_POOL
+        	setGenome(neighborCell,internGenome(outputBuf,outputLength));
+#else
+        	for(i=0;i<words;++i)
+          		neighborCell->genome[i] = OUTPUT_AT(i);
+#endif
+        	setGenotype(&delta,neighbor,cellGenotypeOf(neighborCell,words),1);
+        	logEvent(t,PHYLO_BIRTH,CELL_STATS(neighborCell,neighbor)->ID,neighborCell->parentID,neighbor,
+        		CELL_STATS(neighborCell,neighbor)->generation);
       	}
    }
 
+	uint64_t instructions = 0;
 	#pragma omp critical 
    	{
 		for (i = 0; i < 16; i++) {
 			statCounters.instructionExecutions[i] += instrExecs[i];
+			instructions += instrExecs[i];
 		}
 		statCounters.viableCellsReplaced += cellsReplaced; 
 		statCounters.viableCellsKilled += cellsKilled;
 		statCounters.viableCellShares += cellsShared;
 	}
+	{
+		struct PondStatDeltas *const d = &pondStatDeltas[omp_get_thread_num()];
+		d->energy += delta.energy;
+		d->activeCells += delta.activeCells;
+		d->viableReplicators += delta.viableReplicators;
+		d->genotypes += delta.genotypes;
+		d->countLogCount += delta.countLogCount;
+		d->blankCells += delta.blankCells;
+		if (delta.maxGeneration > d->maxGeneration)
+			d->maxGeneration = delta.maxGeneration;
+	}
+	{
+		struct TelemetryThread *const tt = &threadTotals[omp_get_thread_num()].totals;
+		++tt->cellExecutions;
+		tt->instructions += instructions;
+	}
+	INSTRUMENT(
+	/* One draw per instruction decides whether it mutates */
+	rngDraws += instructions;
+	if (skipped)
+		++vmInstrument->falseLoopSkips[log2Bucket(skipped)];
+	if (deepest > vmInstrument->maxLoopDepth)
+		vmInstrument->maxLoopDepth = deepest;
+	++vmInstrument->executions;
+	vmInstrument->rngDraws += rngDraws;
+	++vmInstrument->instructions[log2Bucket(instructions)];
+	++vmInstrument->draws[log2Bucket(rngDraws)];
+	++vmInstrument->loopDepth[log2Bucket(deepest)];
+	)
+	applyTileDeltas(&delta);
+	markDirty(self);
 	return 1;
 }
 
+static int executeCell256(cellidx_t x, cellidx_t y) { return executeCellKernel(x, y, 256 / INSTR_PER_WORD); }
+static int executeCell512(cellidx_t x, cellidx_t y) { return executeCellKernel(x, y, 512 / INSTR_PER_WORD); }
+static int executeCell1024(cellidx_t x, cellidx_t y) { return executeCellKernel(x, y, 1024 / INSTR_PER_WORD); }
+static int executeCellAny(cellidx_t x, cellidx_t y) { return executeCellKernel(x, y, wordsGenome); }
+
+static void pickBatchPow2() { pickBatchKernel(1); }
+static void pickBatchAny() { pickBatchKernel(0); }
+
+// Kernels for the current run parameters, chosen by selectKernels()
+int (*executeCell)(cellidx_t x, cellidx_t y) = executeCellAny;
+void (*pickBatch)() = pickBatchAny;
+
+static void selectKernels()
+{
+	switch(maxNumInstr) {
+		case 256:	executeCell = executeCell256; break;
+		case 512:	executeCell = executeCell512; break;
+		case 1024:	executeCell = executeCell1024; break;
+		default:	executeCell = executeCellAny; break;
+	}
+	if (!(pondSizeX & (pondSizeX - 1)) && !(pondSizeY & (pondSizeY - 1)))
+		pickBatch = pickBatchPow2;
+	else pickBatch = pickBatchAny;
+
+	fprintf(stderr,"[INFO] Pond %lux%lu, %lu instructions, batch %lu, mutation rate %lu (%s genome kernel, %s picker)\n",
+		pondSizeX,pondSizeY,maxNumInstr,batchSize,mutationRate,
+		(executeCell == executeCellAny) ? "generic" : "specialized",
+		(pickBatch == pickBatchPow2) ? "power-of-two" : "generic");
+}
+
+/**
+ * First prefetch stage for pick i: the cell record, the start of its genome,
+ * its neighbor offsets and the index into its RNG state. These are the
+ * addresses computable from the pick alone.
+ */
+static inline void prefetchEarly(const uintptr_t i)
+{
+	const cellidx_t self = cellIndex(randomLocationX[i],randomLocationY[i]);
+	const char *const c = (const char *)CELL(self,cellStride);
+	__builtin_prefetch(c,1);
+	__builtin_prefetch(c + 64,1);
+	__builtin_prefetch(&neighborOffset[self],0);
+	__builtin_prefetch(&rngIndexArray[randomLocationX[i] + pondSizeX * randomLocationY[i]],1);
+}
+
+/**
+ * Second stage, run prefetchDistance picks after the first: with the first
+ * stage's lines now cached, follow them to the four neighbors' records, the
+ * next word of the cell's Mersenne Twister state and, with the pool, the
+ * shared genome block.
+ */
+static inline void prefetchLate(const uintptr_t i)
+{
+	const cellidx_t self = cellIndex(randomLocationX[i],randomLocationY[i]);
+	const cellidx_t rng = randomLocationX[i] + pondSizeX * randomLocationY[i];
+	const int next = rngIndexArray[rng];
+	uintptr_t dir;
+	for(dir=0;dir<4;++dir)
+		__builtin_prefetch(CELL(self + neighborOffset[self][dir],cellStride),1);
+	__builtin_prefetch(&rngArray[rng][(next < N) ? next : 0],1);
+#ifdef GENOME_POOL
+	__builtin_prefetch(atomic_load_explicit(&CELL(self,cellStride)->genome,memory_order_relaxed)->words,0);
+#endif
+}
+
 void initializePond() {
-	int x = 0, y = 0, i=0;
+	cellidx_t x = 0, y = 0;
+	uintptr_t i = 0;
+#ifdef GENOME_POOL
+	const uintptr_t blankWord = ~((uintptr_t)0);
+	initializeGenomePool();
+#endif
 	// Clear pond and initialize to blank cells
-	for(x=0;x<POND_SIZE_X;++x) {
-		for(y=0;y<POND_SIZE_Y;++y) {
-			cellArray[x][y].ID = 0;
-			cellArray[x][y].parentID = 0;
-			cellArray[x][y].lineage = 0;
-			cellArray[x][y].generation = 0;
-			cellArray[x][y].energy = 0;
-			for(i=0;i<MAX_WORDS_GENOME;++i)
-				cellArray[x][y].genome[i] = ~((uintptr_t)0);
+	for(x=0;x<pondSizeX;++x) {
+		for(y=0;y<pondSizeY;++y) {
+			const cellidx_t self = cellIndex(x,y);
+			struct Cell *const c = CELL(self,cellStride);
+			CELL_STATS(c,self)->ID = 0;
+			c->parentID = 0;
+			CELL_STATS(c,self)->lineage = 0;
+			CELL_STATS(c,self)->generation = 0;
+			c->energy = 0;
+#ifdef GENOME_POOL
+			atomic_init(&c->genome,internGenome(&blankWord,0));
+#else
+			for(i=0;i<wordsGenome;++i)
+				c->genome[i] = ~((uintptr_t)0);
+#endif
+			cellGenotype[self] = cellGenotypeOf(c,wordsGenome);
 		}
 	}
+	initializeNeighbors();
 
     //Seeding RNG with assembly instruction
 	register uint64_t c = 0;
@@ -697,8 +2344,369 @@ static void timeHandler(struct itimerval tval) {
 }
 */
 
+#ifdef HUGE_PAGES
+/* Arrays from allocLarge(), for reportPageSizes() */
+#define MAX_LARGE_ARRAYS 8
+static struct {
+	const char *what;
+	void *base;
+	size_t bytes;
+	int hugetlb;
+} largeArrays[MAX_LARGE_ARRAYS];
+static int numLargeArrays;
+
+/**
+ * Size of the reserved huge pages from /proc/meminfo, or 0 if unknown
+ */
+static size_t hugePageBytes()
+{
+	char line[256];
+	unsigned long kb = 0;
+	FILE *f = fopen("/proc/meminfo","r");
+	if (!f)
+		return 0;
+	while (fgets(line,sizeof(line),f))
+		if (sscanf(line,"Hugepagesize: %lu kB",&kb) == 1)
+			break;
+	fclose(f);
+	return (size_t)kb * 1024;
+}
+
+/**
+ * Zeroed memory for one of the big per-cell arrays. Tries reserved huge
+ * pages first, then an ordinary mapping with transparent huge pages
+ * requested. The ordinary mapping ends in an inaccessible guard page, which
+ * also stops the kernel merging it with its neighbors so that each array
+ * keeps its own line in /proc/self/smaps. Returns NULL only if both fail.
+ */
+static void *allocLarge(const size_t bytes,const char *what)
+{
+	const size_t huge = hugePageBytes();
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t mapped = (bytes + page - 1) / page * page;
+	void *p = MAP_FAILED;
+	int hugetlb = 0;
+
+	if (huge) {
+		p = mmap(NULL,(bytes + huge - 1) / huge * huge,PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+		hugetlb = (p != MAP_FAILED);
+	}
+	if (p == MAP_FAILED) {
+		p = mmap(NULL,mapped + page,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if (p == MAP_FAILED)
+			return NULL;
+		mprotect((uint8_t *)p + mapped,page,PROT_NONE);
+		madvise(p,mapped,MADV_HUGEPAGE);
+	}
+	if (numLargeArrays < MAX_LARGE_ARRAYS) {
+		largeArrays[numLargeArrays].what = what;
+		largeArrays[numLargeArrays].base = p;
+		largeArrays[numLargeArrays].bytes = bytes;
+		largeArrays[numLargeArrays].hugetlb = hugetlb;
+		++numLargeArrays;
+	}
+	return p;
+}
+
+/**
+ * Logs the page size each large array actually got. Transparent huge pages
+ * are only handed out as the memory is touched, so call this after the pond
+ * has been initialized; the count comes from the mapping's entry in
+ * /proc/self/smaps.
+ */
+static void reportPageSizes()
+{
+	char line[256];
+	unsigned long start, end, kb;
+	unsigned long pageKB, hugeKB;
+	int i, found;
+	FILE *f;
+
+	for(i=0;i<numLargeArrays;++i) {
+		pageKB = hugeKB = 0;
+		found = 0;
+		f = fopen("/proc/self/smaps","r");
+		while ((f)&&(fgets(line,sizeof(line),f))) {
+			if (sscanf(line,"%lx-%lx ",&start,&end) == 2) {
+				if (found)
+					break;
+				found = (start == (unsigned long)largeArrays[i].base);
+			} else if (found) {
+				if (sscanf(line,"KernelPageSize: %lu kB",&kb) == 1)
+					pageKB = kb;
+				else if (sscanf(line,"AnonHugePages: %lu kB",&kb) == 1)
+					hugeKB = kb;
+			}
+		}
+		if (f)
+			fclose(f);
+
+		if (largeArrays[i].hugetlb)
+			fprintf(stderr,"[INFO] %s: %lu MiB in %lu kB reserved huge pages\n",
+				largeArrays[i].what,(unsigned long)(largeArrays[i].bytes >> 20),pageKB);
+		else
+			fprintf(stderr,"[INFO] %s: %lu MiB in %lu kB pages, %lu MiB of it transparent huge pages\n",
+				largeArrays[i].what,(unsigned long)(largeArrays[i].bytes >> 20),pageKB,hugeKB >> 10);
+	}
+}
+#endif
+
+/**
+ * Opens the phylogeny log for -l, writes its header and gives every thread
+ * a buffer
+ */
+static void openPhylogeny()
+{
+	struct PhyloLogHeader h;
+	uintptr_t t;
+
+	phyloFd = open(phyloPath,O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,0644);
+	if (phyloFd < 0) {
+		fprintf(stderr,"[ERROR] Could not open %s for writing.\n",phyloPath);
+		exit(1);
+	}
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,PHYLO_MAGIC,sizeof(h.magic));
+	h.version = PHYLO_VERSION;
+	h.eventBytes = sizeof(struct PhyloEvent);
+	h.pondSizeX = pondSizeX;
+	h.pondSizeY = pondSizeY;
+	if (write(phyloFd,&h,sizeof(h)) != sizeof(h)) {
+		fprintf(stderr,"[ERROR] Could not write %s.\n",phyloPath);
+		exit(1);
+	}
+	for(t=0;t<omp_get_max_threads();++t) {
+		if (!(threadLineages[t].events = malloc(PHYLO_BUFFER_EVENTS * sizeof(struct PhyloEvent)))) {
+			fprintf(stderr,"[ERROR] Out of memory allocating phylogeny buffers.\n");
+			exit(1);
+		}
+	}
+	fprintf(stderr,"[INFO] Logging births and deaths to %s\n",phyloPath);
+}
+
+static struct Telemetry *telemetry;     /* Mapped segment, with -t */
+
+/**
+ * Creates the shared memory segment for -t, replacing any left by an
+ * earlier run, and fills in the parts that never change
+ */
+static void openTelemetry()
+{
+	const size_t bytes = sizeof(struct Telemetry) + omp_get_max_threads() * sizeof(struct TelemetryThread);
+	int fd;
+
+	shm_unlink(telemetryName);
+	fd = shm_open(telemetryName,O_RDWR | O_CREAT | O_EXCL,0644);
+	if ((fd < 0)||(ftruncate(fd,bytes))) {
+		fprintf(stderr,"[ERROR] Could not create shared memory segment %s.\n",telemetryName);
+		exit(1);
+	}
+	telemetry = mmap(NULL,bytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if (telemetry == MAP_FAILED) {
+		fprintf(stderr,"[ERROR] Could not map shared memory segment %s.\n",telemetryName);
+		exit(1);
+	}
+	telemetry->version = TELEMETRY_VERSION;
+	telemetry->headerBytes = sizeof(struct Telemetry);
+	telemetry->threadBytes = sizeof(struct TelemetryThread);
+	telemetry->threads = omp_get_max_threads();
+	telemetry->pondSizeX = pondSizeX;
+	telemetry->pondSizeY = pondSizeY;
+	telemetry->pid = getpid();
+	atomic_init(&telemetry->sequence,0);
+	/* Readers take the magic to mean the rest is there */
+	atomic_thread_fence(memory_order_release);
+	memcpy(telemetry->magic,TELEMETRY_MAGIC,sizeof(telemetry->magic));
+	fprintf(stderr,"[INFO] Publishing telemetry to shared memory %s\n",telemetryName);
+}
+
+/**
+ * Republishes the telemetry segment under its seqlock. Called between
+ * batches, so the totals it folds in are exact; costs O(threads).
+ */
+static void publishTelemetry(const uintptr_t clock,const struct timeval *runStart,const struct timeval *batchStart)
+{
+	const uint64_t sequence = atomic_load_explicit(&telemetry->sequence,memory_order_relaxed);
+	uint64_t energy, activeCells, viableReplicators;
+	uintptr_t maxGeneration, t;
+	struct timeval now;
+
+	collectPondTotals(&energy,&activeCells,&viableReplicators,&maxGeneration);
+	gettimeofday(&now,NULL);
+
+	atomic_store_explicit(&telemetry->sequence,sequence + 1,memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	telemetry->clock = clock;
+	++telemetry->batches;
+	telemetry->batchNanoseconds = (now.tv_sec - batchStart->tv_sec) * 1000000000ULL + (now.tv_usec - batchStart->tv_usec) * 1000;
+	telemetry->runNanoseconds = (now.tv_sec - runStart->tv_sec) * 1000000000ULL + (now.tv_usec - runStart->tv_usec) * 1000;
+	telemetry->energy = energy;
+	telemetry->activeCells = activeCells;
+	telemetry->viableReplicators = viableReplicators;
+	telemetry->maxGeneration = maxGeneration;
+	telemetry->genotypes = censusGenotypes;
+	telemetry->dominantGenotype = atomic_load_explicit(&dominantGenotype,memory_order_relaxed);
+	telemetry->cellExecutions = (uint64_t)statCounters.cellExecutions;
+	telemetry->viableCellsReplaced = statCounters.viableCellsReplaced;
+	telemetry->viableCellsKilled = statCounters.viableCellsKilled;
+	telemetry->viableCellShares = statCounters.viableCellShares;
+	for(t=0;t<16;++t)
+		telemetry->instructionExecutions[t] = (uint64_t)statCounters.instructionExecutions[t];
+	for(t=0;t<telemetry->threads;++t)
+		telemetry->thread[t] = threadTotals[t].totals;
+	atomic_store_explicit(&telemetry->sequence,sequence + 2,memory_order_release);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-x width] [-y height] [-g instructions] [-b batch] [-m mutation rate] [-p distance]\n"
+		"       [-s clocks] [-k reports] [-z level] [-l file] [-t name]\n"
+		"  -x  pond width in cells (default %d)\n"
+		"  -y  pond height in cells (default %d)\n"
+		"  -g  genome depth in instructions, a multiple of %lu from %lu to %d (default %d)\n"
+		"  -b  cells executed per parallel batch, at least %d and dividing %d (default %d)\n"
+		"  -m  mutation rate out of 2^32 per instruction (default %d)\n"
+		"  -p  prefetch distance in picks, 0 for none (default %d)\n"
+		"  -s  clocks between clock report snapshots, a multiple of -b (default %d)\n"
+		"  -k  clock reports per full snapshot; the others hold only changed cells (default %d)\n"
+		"  -z  zlib level for reports, 0 to write them plain (default %d; pe-zlib builds only)\n"
+		"  -l  append every birth and death to this phylogeny log (see phyloTree.c)\n"
+		"  -t  publish live counters to this POSIX shared memory segment, e.g. /nanopond (see teleWatch.c)\n",
+		prog,POND_SIZE_X,POND_SIZE_Y,(unsigned long)INSTR_PER_WORD,(unsigned long)MIN_NUM_INSTR,
+		MAX_NUM_INSTR_LIMIT,MAX_NUM_INSTR,INFLOW_FREQUENCY,CLOCKUPDATE_FREQUENCY,BATCH_SIZE,MUTATION_RATE,PREFETCH_DISTANCE,
+		CLOCKREPORT_FREQUENCY,KEYFRAME_INTERVAL,REPORT_COMPRESSION);
+}
+
+/**
+ * Reads the run parameters and allocates everything sized by them.
+ */
+static void configure(int argc, char **argv)
+{
+	int opt, t;
+	while ((opt = getopt(argc,argv,"x:y:g:b:m:p:s:k:z:l:t:h")) != -1) {
+		switch(opt) {
+			case 'x': pondSizeX = strtoull(optarg,NULL,0); break;
+			case 'y': pondSizeY = strtoull(optarg,NULL,0); break;
+			case 'g': maxNumInstr = strtoul(optarg,NULL,0); break;
+			case 'b': batchSize = strtoul(optarg,NULL,0); break;
+			case 'm': mutationRate = strtoul(optarg,NULL,0); break;
+			case 'p': prefetchDistance = strtoul(optarg,NULL,0); break;
+			case 's': clockReportFrequency = strtoul(optarg,NULL,0); break;
+			case 'k': keyframeInterval = strtoul(optarg,NULL,0); break;
+			case 'z': reportCompression = atoi(optarg); break;
+			case 'l': phyloPath = optarg; break;
+			case 't': telemetryName = optarg; break;
+			default: usage(argv[0]); exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if ((pondSizeX < 2)||(pondSizeY < 2)) {
+		fprintf(stderr,"[ERROR] Pond size %lux%lu is out of range.\n",pondSizeX,pondSizeY);
+		exit(1);
+	}
+#ifdef TILED_CELL_LAYOUT
+	if ((pondSizeX % TILE_SIDE)||(pondSizeY % TILE_SIDE)) {
+		fprintf(stderr,"[ERROR] TILED_CELL_LAYOUT needs the pond size to be a multiple of %d.\n",TILE_SIDE);
+		exit(1);
+	}
+#endif
+	if ((maxNumInstr < MIN_NUM_INSTR)||(maxNumInstr > MAX_NUM_INSTR_LIMIT)||(maxNumInstr % INSTR_PER_WORD)) {
+		fprintf(stderr,"[ERROR] Genome depth %lu is not a multiple of %lu from %lu to %d.\n",
+			maxNumInstr,(unsigned long)INSTR_PER_WORD,(unsigned long)MIN_NUM_INSTR,MAX_NUM_INSTR_LIMIT);
+		exit(1);
+	}
+	if (batchSize < INFLOW_FREQUENCY) {
+		fprintf(stderr,"[ERROR] Batch size must be at least %d.\n",INFLOW_FREQUENCY);
+		exit(1);
+	}
+	/* Updates and reports happen when the clock, which moves a batch at a
+	 * time, lands on a multiple of their frequency */
+	if ((CLOCKUPDATE_FREQUENCY % batchSize)||(UPDATE_FREQUENCY % batchSize)||(REPORT_FREQUENCY % batchSize)) {
+		fprintf(stderr,"[ERROR] Batch size must divide %d, %d and %d.\n",CLOCKUPDATE_FREQUENCY,UPDATE_FREQUENCY,REPORT_FREQUENCY);
+		exit(1);
+	}
+	if ((clockReportFrequency == 0)||(keyframeInterval == 0)) {
+		fprintf(stderr,"[ERROR] Clock report and keyframe intervals must be at least 1.\n");
+		exit(1);
+	}
+	if (clockReportFrequency % batchSize) {
+		fprintf(stderr,"[ERROR] Clock report interval must be a multiple of the batch size (%lu).\n",(uint64_t)batchSize);
+		exit(1);
+	}
+#ifdef COMPRESS_REPORTS
+	if ((reportCompression < 0)||(reportCompression > 9)) {
+		fprintf(stderr,"[ERROR] Report compression level %d is not from 0 to 9.\n",reportCompression);
+		exit(1);
+	}
+#else
+	if (reportCompression) {
+		fprintf(stderr,"[ERROR] Compressed reports need a build with COMPRESS_REPORTS (make pe-zlib).\n");
+		exit(1);
+	}
+#endif
+
+	numCells = geometryMul(pondSizeX,pondSizeY,"Pond size");
+	wordsGenome = maxNumInstr / INSTR_PER_WORD;
+	cellStride = CELL_BYTES(wordsGenome);
+	cellPickIndex = numCells;
+
+#ifdef HUGE_PAGES
+	cellArray = allocLarge(geometryMul(numCells,cellStride,"Cell array"),"cellArray");
+	rngArray = allocLarge(geometryMul(numCells + 1,sizeof(*rngArray),"RNG array"),"rngArray");
+	rngIndexArray = allocLarge(geometryMul(numCells + 1,sizeof(*rngIndexArray),"RNG index array"),"rngIndexArray");
+	neighborOffset = allocLarge(geometryMul(numCells,sizeof(*neighborOffset),"Neighbor table"),"neighborOffset");
+#else
+	if (posix_memalign((void **)&cellArray,64,geometryMul(numCells,cellStride,"Cell array"))) cellArray = NULL;
+	rngArray = malloc(geometryMul(numCells + 1,sizeof(*rngArray),"RNG array"));
+	rngIndexArray = malloc(geometryMul(numCells + 1,sizeof(*rngIndexArray),"RNG index array"));
+	neighborOffset = malloc(geometryMul(numCells,sizeof(*neighborOffset),"Neighbor table"));
+#endif
+	if (posix_memalign((void **)&pondStatDeltas,64,omp_get_max_threads() * sizeof(*pondStatDeltas))) pondStatDeltas = NULL;
+	if (posix_memalign((void **)&threadTotals,64,omp_get_max_threads() * sizeof(*threadTotals))) threadTotals = NULL;
+#ifdef INSTRUMENT_VM
+	if (posix_memalign((void **)&vmInstruments,64,omp_get_max_threads() * sizeof(*vmInstruments))) vmInstruments = NULL;
+#endif
+	statTilesX = (pondSizeX + STAT_TILE_SIDE - 1) / STAT_TILE_SIDE;
+	statTilesY = (pondSizeY + STAT_TILE_SIDE - 1) / STAT_TILE_SIDE;
+	if (posix_memalign((void **)&statTiles,64,geometryMul(statTilesX * statTilesY,sizeof(*statTiles),"Stat tiles"))) statTiles = NULL;
+	dirtyCells = calloc((numCells + 63) / 64,sizeof(*dirtyCells));
+	cellGenotype = malloc(geometryMul(numCells,sizeof(*cellGenotype),"Genotype array"));
+	threadLineages = calloc(omp_get_max_threads(),sizeof(*threadLineages));
+	randomLocationX = malloc(batchSize * sizeof(*randomLocationX));
+	randomLocationY = malloc(batchSize * sizeof(*randomLocationY));
+#ifdef SPLIT_CELL_LAYOUT
+#ifdef HUGE_PAGES
+	cellStatsArray = allocLarge(geometryMul(numCells,sizeof(*cellStatsArray),"Cell stats array"),"cellStatsArray");
+#else
+	cellStatsArray = malloc(geometryMul(numCells,sizeof(*cellStatsArray),"Cell stats array"));
+#endif
+	if (!cellStatsArray) cellArray = NULL;
+#endif
+	if (!cellArray||!rngArray||!rngIndexArray||!neighborOffset||!pondStatDeltas||!threadTotals||!statTiles||!dirtyCells||!cellGenotype||!threadLineages||!randomLocationX||!randomLocationY INSTRUMENT(||!vmInstruments)) {
+		fprintf(stderr,"[ERROR] Out of memory allocating a %lux%lu pond.\n",pondSizeX,pondSizeY);
+		exit(1);
+	}
+
+	memset(pondStatDeltas,0,omp_get_max_threads() * sizeof(*pondStatDeltas));
+	for(t=0;t<omp_get_max_threads();++t)
+		pondStatDeltas[t].tile = NO_STAT_TILE;
+	memset(threadTotals,0,omp_get_max_threads() * sizeof(*threadTotals));
+	INSTRUMENT(memset(vmInstruments,0,omp_get_max_threads() * sizeof(*vmInstruments));)
+	memset(statTiles,0,statTilesX * statTilesY * sizeof(*statTiles));
+	reserveGenerations();
+	maintainCensus();
+	if (phyloPath)
+		openPhylogeny();
+	if (telemetryName)
+		openTelemetry();
+	selectKernels();
+}
+
 //main
-int main()  {
+int main(int argc, char **argv)  {
 	struct timeval runStart, runStop;
 	gettimeofday(&runStart, NULL);
 /*
@@ -710,19 +2718,28 @@ int main()  {
 	(void) setitimer(ITIMER_REAL, &tvalStop, NULL);
 #endif
 */
-	int i,x,y;
-	int cellPickIndex = POND_SIZE_X * POND_SIZE_Y;
+	uintptr_t i, w;
+	cellidx_t x,y,self;
 	struct Cell *currCell;
+#ifdef GENOME_POOL
+	uintptr_t newGenome[MAX_WORDS_LIMIT];
+#endif
 	uintptr_t clock = 0;
-	// TODO: allow all cells access to id counter somehow
-	uint64_t cellIDCounter = 0;
+
+	configure(argc, argv);
 
 	// Sets all cell attributes to 0 and seeds RNGs
 	initializePond();
+#ifdef HUGE_PAGES
+	reportPageSizes();
+#endif
+#ifdef COUNT_LLC_MISSES
+	openLLCCounters();
+#endif
 
     // Batch execution loop
     for (;;){
-
+	batchClock = clock;
 	
 	// Set timer to start measuring how long batch picking and parallel loop takes
 	struct timeval fcnStart, fcnStop;
@@ -734,8 +2751,25 @@ int main()  {
 // Parallel for loop to execute each cell
 #pragma omp parallel private(i) 
 {
-        #pragma omp for  
-        for (i = 0; i < BATCH_SIZE; i++) {
+	// Each thread runs a contiguous run of picks and keeps its prefetches
+	// 2 * prefetchDistance (first stage) and prefetchDistance (second
+	// stage) picks ahead of the one it is executing
+	uintptr_t j, primed = 0;
+        #pragma omp for schedule(static)
+        for (i = 0; i < batchSize; i++) {
+		if (prefetchDistance) {
+			if (!primed) {
+				for (j = i; (j < i + 2 * prefetchDistance)&&(j < batchSize); j++)
+					prefetchEarly(j);
+				for (j = i; (j < i + prefetchDistance)&&(j < batchSize); j++)
+					prefetchLate(j);
+				primed = 1;
+			}
+			if (i + 2 * prefetchDistance < batchSize)
+				prefetchEarly(i + 2 * prefetchDistance);
+			if (i + prefetchDistance < batchSize)
+				prefetchLate(i + prefetchDistance);
+		}
 		//if (cellArray[randomLocationX[i]][randomLocationY[i]].energy)
 			executeCell(randomLocationX[i], randomLocationY[i]);
 
@@ -753,33 +2787,61 @@ int main()  {
 //	printf("array rng 1st time: %lf 2nd time: %lf difference: %lf \n", (float) fcnStart.tv_sec, (float) fcnStop.tv_sec, (fcnStop.tv_sec - fcnStart.tv_sec) + (fcnStop.tv_usec - fcnStart.tv_usec)/1000000.0); 
 
 	// Increment clock and number of cell executions by batch size
-	clock += BATCH_SIZE;
-	statCounters.cellExecutions += BATCH_SIZE;
+	clock += batchSize;
+	statCounters.cellExecutions += batchSize;
 	
 	// Introduce random cell with energy. Do this as many times as needed relative to batch size.	
-	for (i = 0; i < BATCH_SIZE / INFLOW_FREQUENCY; i++) {
-	x = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
-	y = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
-	currCell = &cellArray[x][y];
-	currCell->ID = cellIDCounter;
+	for (i = 0; i < batchSize / INFLOW_FREQUENCY; i++) {
+	x = getRandomFromArray(cellPickIndex) % pondSizeX;
+	y = getRandomFromArray(cellPickIndex) % pondSizeY;
+	self = cellIndex(x,y);
+	currCell = CELL(self,cellStride);
+	const uintptr_t e0 = currCell->energy, g0 = CELL_STATS(currCell,self)->generation;
+	if (e0)
+		logEvent(&threadLineages[0],PHYLO_REPLACED,CELL_STATS(currCell,self)->ID,0,self,g0);
+	CELL_STATS(currCell,self)->ID = newCellID(&threadLineages[0]);
 	currCell->parentID = 0;
-	currCell->lineage = cellIDCounter;
-	currCell->generation = 0;
+	CELL_STATS(currCell,self)->lineage = CELL_STATS(currCell,self)->ID;
+	CELL_STATS(currCell,self)->generation = 0;
 #ifdef INFLOW_RATE_VARIATION
-	currCell->energy += INFLOW_RATE_BASE + (getRandomFromArray(POND_SIZE_X * POND_SIZE_Y) % INFLOW_RATE_VARIATION);
+	currCell->energy += INFLOW_RATE_BASE + (getRandomFromArray(cellPickIndex) % INFLOW_RATE_VARIATION);
 #else
 	currCell->energy += INFLOW_RATE_BASE;
 #endif
-	for(i=0;i<MAX_WORDS_GENOME;++i) 
-		currCell->genome[i] = getRandomFromArray(POND_SIZE_X * POND_SIZE_Y);
-	++cellIDCounter;
+	noteCell(&pondStatDeltas[0],self,e0,g0,currCell->energy,0);
+	atomic_store_explicit(&statTiles[statTileOf(self)].dirty,1,memory_order_relaxed);
+#ifdef GENOME_POOL
+	for(w=0;w<wordsGenome;++w) 
+		newGenome[w] = getRandomFromArray(cellPickIndex);
+	setGenome(currCell,internGenome(newGenome,wordsGenome));
+#else
+	for(w=0;w<wordsGenome;++w) 
+		currCell->genome[w] = getRandomFromArray(cellPickIndex);
+#endif
+	setGenotype(&pondStatDeltas[0],self,cellGenotypeOf(currCell,wordsGenome),1);
+	logEvent(&threadLineages[0],PHYLO_INFLOW,CELL_STATS(currCell,self)->ID,0,self,0);
 	}
+	reserveGenerations();
+	maintainCensus();
+
+#ifdef GENOME_POOL
+	// Nothing else is running, so unreferenced genomes can be freed now
+	collectGenomes();
+#endif
+	if (telemetry)
+		publishTelemetry(clock,&runStart,&fcnStart);
 
  #ifdef STOP_AT
         if ((clock >= STOP_AT)) {
                 
 		gettimeofday(&runStop, NULL);
 		printf("run start: %lf run stop: %lf difference: %lf \n", (float) runStart.tv_sec, (float) runStop.tv_sec, (runStop.tv_sec - runStart.tv_sec) + (runStop.tv_usec - runStart.tv_usec)/1000000.0); 
+		waitForSnapshots(0);
+		flushAllPhylogeny();
+#ifdef INSTRUMENT_VM
+		reportInstruments();
+		printInstruments("over the run",&vmRunTotals);
+#endif
 		exit(0);
 	}
 #endif 
@@ -792,7 +2854,7 @@ int main()  {
 	// Do updates and reports at defined intervals
         if (!(clock % CLOCKUPDATE_FREQUENCY)) 
                 doClockUpdate(clock);
-        if (!(clock % CLOCKREPORT_FREQUENCY)) 
+        if (!(clock % clockReportFrequency)) 
                 doClockReport(clock);
         if (!(clock % UPDATE_FREQUENCY))
                 doUpdate(clock);
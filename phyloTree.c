@@ -0,0 +1,272 @@
+/* Rebuilds the family tree of a run from the phylogeny log parallelEdit.c
+ * writes with -l, and prints one line per cell that ever lived:
+ *
+ *   phylotree run.phylo > run.tree.csv
+ *
+ * The columns are id,parent,birth,death,genotype,generation,children, with
+ * parent 0 for cells from the inflow and death empty for cells still alive
+ * at the end of the log. Death is the earliest event that ended the cell;
+ * see phylogeny.h for why there can be more than one.
+ *
+ * With -n it prints the families that had offspring as Newick trees instead,
+ * one per line, each branch as long as the clocks between a cell's birth and
+ * its parent's:
+ *
+ *   phylotree -n run.phylo > run.nwk
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "phylogeny.h"
+
+/* Events read per fread() */
+#define EVENT_BUFFER (1 << 16)
+
+/* Death clock of cells still alive */
+#define ALIVE UINT64_MAX
+
+/**
+ * malloc() that stops with an error on failure
+ */
+static void *allocOrDie(const size_t bytes)
+{
+	void *p = malloc(bytes ? bytes : 1);
+	if (!p) {
+		fprintf(stderr,"[ERROR] Out of memory allocating %lu bytes.\n",(unsigned long)bytes);
+		exit(1);
+	}
+	return p;
+}
+
+/* Everything known about each cell, indexed by ID */
+struct Tree {
+	uint64_t maxID;
+	uint64_t *parent;
+	uint64_t *birth;
+	uint64_t *death;
+	uint64_t *genotype;
+	uint32_t *generation;
+	uint32_t *children;
+	uint8_t *born;          /* Had a birth or inflow record */
+	uint8_t *cause;         /* enum PhyloEventType that ended it */
+};
+
+/**
+ * Opens a phylogeny log and checks its header, leaving f at the first event
+ */
+static FILE *openLog(const char *name)
+{
+	struct PhyloLogHeader h;
+	FILE *f = fopen(name,"rb");
+	if (!f) {
+		fprintf(stderr,"[ERROR] Could not open %s.\n",name);
+		exit(1);
+	}
+	if ((fread(&h,sizeof(h),1,f) != 1)||(memcmp(h.magic,PHYLO_MAGIC,sizeof(h.magic)))) {
+		fprintf(stderr,"[ERROR] %s is not a phylogeny log.\n",name);
+		exit(1);
+	}
+	if ((h.version != PHYLO_VERSION)||(h.eventBytes != sizeof(struct PhyloEvent))) {
+		fprintf(stderr,"[ERROR] %s is version %u with %u-byte events; this reads version %d with %lu-byte events.\n",
+			name,h.version,h.eventBytes,PHYLO_VERSION,(unsigned long)sizeof(struct PhyloEvent));
+		exit(1);
+	}
+	return f;
+}
+
+/**
+ * Reads the next run of events from f into buffer, returning how many; a
+ * partial record at the end, from a run that did not finish, is dropped
+ */
+static size_t readEvents(FILE *f,struct PhyloEvent *buffer)
+{
+	return fread(buffer,sizeof(struct PhyloEvent),EVENT_BUFFER,f);
+}
+
+/**
+ * Reads the whole log into the tree: one pass for the largest ID so the
+ * arrays can be sized, then one to fill them in
+ */
+static void readTree(const char *name,struct Tree *tree,uint64_t counts[PHYLO_STARVED + 1])
+{
+	struct PhyloEvent *buffer = allocOrDie(EVENT_BUFFER * sizeof(struct PhyloEvent)), *e;
+	FILE *f = openLog(name);
+	const long start = ftell(f);
+	size_t n, j;
+	uint64_t id;
+
+	tree->maxID = 0;
+	while ((n = readEvents(f,buffer)) > 0)
+		for(j=0;j<n;++j)
+			if (buffer[j].id > tree->maxID)
+				tree->maxID = buffer[j].id;
+
+	tree->parent = allocOrDie((tree->maxID + 1) * sizeof(uint64_t));
+	tree->birth = allocOrDie((tree->maxID + 1) * sizeof(uint64_t));
+	tree->death = allocOrDie((tree->maxID + 1) * sizeof(uint64_t));
+	tree->genotype = allocOrDie((tree->maxID + 1) * sizeof(uint64_t));
+	tree->generation = allocOrDie((tree->maxID + 1) * sizeof(uint32_t));
+	tree->children = allocOrDie((tree->maxID + 1) * sizeof(uint32_t));
+	tree->born = allocOrDie(tree->maxID + 1);
+	tree->cause = allocOrDie(tree->maxID + 1);
+	memset(tree->children,0,(tree->maxID + 1) * sizeof(uint32_t));
+	memset(tree->born,0,tree->maxID + 1);
+	tree->generation[0] = 0;
+	for(id=0;id<=tree->maxID;++id)
+		tree->death[id] = ALIVE;
+	memset(counts,0,(PHYLO_STARVED + 1) * sizeof(uint64_t));
+
+	fseek(f,start,SEEK_SET);
+	while ((n = readEvents(f,buffer)) > 0) {
+		for(j=0;j<n;++j) {
+			e = &buffer[j];
+			if ((e->type > PHYLO_STARVED)||(!e->id)) {
+				fprintf(stderr,"[ERROR] %s has a corrupt event.\n",name);
+				exit(1);
+			}
+			++counts[e->type];
+			if (e->type <= PHYLO_INFLOW) {
+				tree->born[e->id] = 1;
+				tree->parent[e->id] = e->parentID;
+				tree->birth[e->id] = e->clock;
+				tree->genotype[e->id] = e->genotype;
+				tree->generation[e->id] = e->generation;
+			} else if (e->clock < tree->death[e->id]) {
+				/* Runs from different threads are out of clock order */
+				tree->death[e->id] = e->clock;
+				tree->cause[e->id] = e->type;
+			}
+		}
+	}
+	fclose(f);
+	free(buffer);
+
+	/* Offspring of parents the log never saw born become roots */
+	for(id=1;id<=tree->maxID;++id) {
+		if (!tree->born[id])
+			continue;
+		if ((tree->parent[id] > tree->maxID)||(!tree->born[tree->parent[id]]))
+			tree->parent[id] = 0;
+		else ++tree->children[tree->parent[id]];
+	}
+}
+
+static void writeCSV(const struct Tree *tree)
+{
+	uint64_t id;
+	printf("id,parent,birth,death,genotype,generation,children\n");
+	for(id=1;id<=tree->maxID;++id) {
+		if (!tree->born[id])
+			continue;
+		printf("%lu,%lu,%lu,",id,tree->parent[id],tree->birth[id]);
+		if (tree->death[id] != ALIVE)
+			printf("%lu",tree->death[id]);
+		printf(",%.16lx,%u,%u\n",tree->genotype[id],tree->generation[id],tree->children[id]);
+	}
+}
+
+/**
+ * Prints every root with offspring as a Newick tree. Lineages run to
+ * millions of generations, so the walk keeps its own stack.
+ */
+static void writeNewick(const struct Tree *tree)
+{
+	uint64_t *first = allocOrDie((tree->maxID + 2) * sizeof(uint64_t));
+	uint64_t *list = allocOrDie((tree->maxID + 1) * sizeof(uint64_t));
+	uint64_t *next = allocOrDie((tree->maxID + 1) * sizeof(uint64_t));
+	uint64_t *stack = allocOrDie((tree->maxID + 1) * sizeof(uint64_t));
+	uint64_t id, root, depth, c;
+
+	/* Children of each cell, in ID order, at list[first[id]] up to first[id + 1] */
+	first[0] = 0;
+	for(id=0;id<=tree->maxID;++id)
+		first[id + 1] = first[id] + tree->children[id];
+	memcpy(next,first,(tree->maxID + 1) * sizeof(uint64_t));
+	for(id=1;id<=tree->maxID;++id)
+		if ((tree->born[id])&&(tree->parent[id]))
+			list[next[tree->parent[id]]++] = id;
+
+	for(root=1;root<=tree->maxID;++root) {
+		if ((!tree->born[root])||(tree->parent[root])||(!tree->children[root]))
+			continue;
+		/* next[] now walks each cell's children as they are printed */
+		stack[0] = root;
+		next[root] = first[root];
+		putchar('(');
+		depth = 1;
+		while (depth) {
+			id = stack[depth - 1];
+			if (next[id] < first[id + 1]) {
+				if (next[id] > first[id])
+					putchar(',');
+				c = list[next[id]++];
+				if (tree->children[c]) {
+					putchar('(');
+					next[c] = first[c];
+					stack[depth++] = c;
+				} else printf("%lu:%lu",c,tree->birth[c] - tree->birth[id]);
+			} else {
+				--depth;
+				if (depth)
+					printf(")%lu:%lu",id,tree->birth[id] - tree->birth[stack[depth - 1]]);
+				else printf(")%lu;\n",id);
+			}
+		}
+	}
+	free(first);
+	free(list);
+	free(next);
+	free(stack);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,"Usage: %s [-n] <phylogeny log>\n"
+		"  -n  print families with offspring as Newick trees instead of CSV\n",prog);
+}
+
+int main(int argc,char **argv)
+{
+	struct Tree tree;
+	uint64_t counts[PHYLO_STARVED + 1], id, cells = 0, alive = 0, deepest = 0, largest = 0;
+	int opt, newick = 0;
+
+	while ((opt = getopt(argc,argv,"nh")) != -1) {
+		switch (opt) {
+			case 'n': newick = 1; break;
+			default: usage(argv[0]); return (opt == 'h') ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	readTree(argv[optind],&tree,counts);
+	for(id=1;id<=tree.maxID;++id) {
+		if (!tree.born[id])
+			continue;
+		++cells;
+		if (tree.death[id] == ALIVE)
+			++alive;
+		if (tree.generation[id] > tree.generation[deepest])
+			deepest = id;
+		if (tree.children[id] > tree.children[largest])
+			largest = id;
+	}
+	fprintf(stderr,"[INFO] %lu cells: %lu from the inflow, %lu born, %lu still alive\n",
+		cells,counts[PHYLO_INFLOW],counts[PHYLO_BIRTH],alive);
+	fprintf(stderr,"[INFO] End events: %lu replaced, %lu killed, %lu starved\n",
+		counts[PHYLO_REPLACED],counts[PHYLO_KILLED],counts[PHYLO_STARVED]);
+	if (cells)
+		fprintf(stderr,"[INFO] Deepest cell %lu at generation %u; most prolific %lu with %u offspring\n",
+			deepest,tree.generation[deepest],largest,tree.children[largest]);
+
+	if (newick)
+		writeNewick(&tree);
+	else writeCSV(&tree);
+	return (fflush(stdout) == 0) ? 0 : 1;
+}
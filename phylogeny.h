@@ -0,0 +1,48 @@
+/* Phylogeny event log, written by parallelEdit.c when run with -l (see
+ * logEvent()) and turned into a tree by phyloTree.c.
+ *
+ * The log is a PhyloLogHeader followed by PhyloEvent records, appended a
+ * thread's buffer at a time, so records from different threads interleave
+ * in runs and clocks only increase within a thread's runs. Every cell that
+ * ever lived has one birth record; the records that end it, if any, name it
+ * by ID. There can be more than one: a killed cell keeps its energy until it
+ * starves or is replaced, and a starved one keeps its genome and ID, so a
+ * SHARE can bring it back to end again. Readers take the earliest, as
+ * phyloTree.c does. Everything is in the byte order of the machine that
+ * wrote it. */
+
+#ifndef PHYLOGENY_H
+#define PHYLOGENY_H
+
+#include <stdint.h>
+
+#define PHYLO_MAGIC "NPPHYLO"   /* Eight bytes with the terminator */
+#define PHYLO_VERSION 1
+
+struct PhyloLogHeader {
+	char magic[8];          /* PHYLO_MAGIC */
+	uint32_t version;       /* PHYLO_VERSION */
+	uint32_t eventBytes;    /* sizeof(struct PhyloEvent) */
+	uint64_t pondSizeX;
+	uint64_t pondSizeY;
+};
+
+enum PhyloEventType {
+	PHYLO_BIRTH,            /* Offspring placed by its parent */
+	PHYLO_INFLOW,           /* Random cell from the inflow; parentID is 0 */
+	PHYLO_REPLACED,         /* Overwritten by offspring or by the inflow */
+	PHYLO_KILLED,           /* Genome wiped by a neighbor's KILL */
+	PHYLO_STARVED           /* Ran out of energy */
+};
+
+struct PhyloEvent {
+	uint64_t clock;         /* Clock at the start of the batch */
+	uint64_t id;            /* Cell born or ended */
+	uint64_t parentID;      /* Births only */
+	uint64_t genotype;      /* Births only; see genotypeOf() in parallelEdit.c */
+	uint64_t position;      /* x * pondSizeY + y */
+	uint32_t type;          /* enum PhyloEventType */
+	uint32_t generation;
+};
+
+#endif /* PHYLOGENY_H */
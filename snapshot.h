@@ -0,0 +1,68 @@
+/* Binary pond snapshots, written by parallelEdit.c (see writeSnapshot()) and
+ * turned back into the old text reports by snapshotText.c.
+ *
+ * A snapshot is a SnapshotHeader followed by one column per SnapshotColumn,
+ * in that order, each holding a uint64_t for every cell in the file, and then
+ * the genomes: wordsGenome words of wordBytes bytes per cell, packed four bits
+ * per instruction exactly as the pond holds them. Cells appear in pond order,
+ * x major, and the position column gives each one's x * pondSizeY + y.
+ * Everything is in the byte order of the machine that wrote it; byteOrder
+ * lets a reader tell.
+ *
+ * Clock reports form a stream of keyframes, which hold the whole pond, and
+ * deltas, which hold only the cells written since the snapshot at baseClock.
+ * Applying each delta in turn to the keyframe before it gives the pond at
+ * that delta's clock.
+ *
+ * In a snapshot flagged SNAPSHOT_COMPRESSED, everything after the header is
+ * a series of frames: a SnapshotFrame, then packedBytes of zlib data that
+ * inflate to the next rawBytes of the layout above. Each frame stands alone,
+ * so a reader can inflate them in parallel. */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "NPSNAP\0"       /* Eight bytes with the terminator */
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+/* SnapshotHeader flags */
+#define SNAPSHOT_VIABLE_ONLY 1  /* Only cells with energy past generation 2 */
+#define SNAPSHOT_DELTA 2        /* Only cells written since baseClock */
+#define SNAPSHOT_COMPRESSED 4   /* Body is in zlib frames */
+
+struct SnapshotHeader {
+	char magic[8];          /* SNAPSHOT_MAGIC */
+	uint32_t version;       /* SNAPSHOT_VERSION */
+	uint32_t byteOrder;     /* SNAPSHOT_BYTE_ORDER as the writer stored it */
+	uint32_t headerBytes;   /* sizeof(struct SnapshotHeader); columns start here */
+	uint32_t flags;
+	uint64_t clock;
+	uint64_t pondSizeX;
+	uint64_t pondSizeY;
+	uint64_t cellCount;     /* Cells in the file */
+	uint32_t maxNumInstr;
+	uint32_t wordsGenome;
+	uint32_t wordBytes;     /* sizeof(uintptr_t) of the writer */
+	uint32_t reserved;
+	uint64_t baseClock;     /* Clock of the snapshot a delta applies to */
+};
+
+struct SnapshotFrame {
+	uint32_t rawBytes;
+	uint32_t packedBytes;
+};
+
+enum SnapshotColumn {
+	SNAPSHOT_POSITION,
+	SNAPSHOT_ID,
+	SNAPSHOT_PARENT_ID,
+	SNAPSHOT_LINEAGE,
+	SNAPSHOT_GENERATION,
+	SNAPSHOT_ENERGY,
+	SNAPSHOT_COLUMNS
+};
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,297 @@
+/* Turns pond snapshots written by parallelEdit.c back into the text report
+ * it used to write: an "ID: ..." line per cell followed by its genome in hex,
+ * one digit per instruction, up to the fourth STOP in a row.
+ *
+ *   snaptext p10000000.report.snap > p10000000.report.csv
+ *
+ * Given a keyframe followed by the deltas after it, in order, it rebuilds the
+ * pond as of the last delta and prints that:
+ *
+ *   snaptext c0.report.snap c100000.report.snap c200000.report.snap
+ *
+ * Compressed snapshots are inflated a frame at a time as they are read.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "snapshot.h"
+
+/* Genome words read per fread() */
+#define GENOME_BUFFER_WORDS (1 << 19)
+
+/**
+ * Reads count items of size bytes from f into p, or stops with an error
+ */
+static void readAll(void *p,const size_t size,const size_t count,FILE *f,const char *name)
+{
+	if (fread(p,size,count,f) != count) {
+		fprintf(stderr,"[ERROR] %s is truncated.\n",name);
+		exit(1);
+	}
+}
+
+/* An open snapshot, positioned somewhere in its body */
+struct SnapshotIn {
+	FILE *f;
+	const char *name;
+	int compressed;
+	uint8_t *raw;           /* The current frame, inflated */
+	uint8_t *packed;
+	size_t rawSize, packedSize;     /* Bytes allocated for each */
+	size_t have, used;      /* Bytes in raw, and bytes of those handed out */
+};
+
+/**
+ * malloc() that stops with an error on failure
+ */
+static void *allocOrDie(const size_t bytes)
+{
+	void *p = malloc(bytes ? bytes : 1);
+	if (!p) {
+		fprintf(stderr,"[ERROR] Out of memory allocating %lu bytes.\n",(unsigned long)bytes);
+		exit(1);
+	}
+	return p;
+}
+
+/**
+ * Inflates the next frame of a compressed snapshot into in->raw
+ */
+static void nextFrame(struct SnapshotIn *in)
+{
+	struct SnapshotFrame frame;
+	uLongf rawBytes;
+	readAll(&frame,sizeof(frame),1,in->f,in->name);
+	if (frame.rawBytes > in->rawSize) {
+		free(in->raw);
+		in->raw = allocOrDie(in->rawSize = frame.rawBytes);
+	}
+	if (frame.packedBytes > in->packedSize) {
+		free(in->packed);
+		in->packed = allocOrDie(in->packedSize = frame.packedBytes);
+	}
+	readAll(in->packed,1,frame.packedBytes,in->f,in->name);
+	rawBytes = frame.rawBytes;
+	if ((uncompress(in->raw,&rawBytes,in->packed,frame.packedBytes) != Z_OK)||(rawBytes != frame.rawBytes)) {
+		fprintf(stderr,"[ERROR] %s has a corrupt frame.\n",in->name);
+		exit(1);
+	}
+	in->have = rawBytes;
+	in->used = 0;
+}
+
+/**
+ * Reads count items of size bytes from the body of a snapshot into p
+ */
+static void readSnapshot(struct SnapshotIn *in,void *p,const size_t size,const size_t count)
+{
+	size_t bytes = size * count, n;
+	uint8_t *dst = p;
+	if (!in->compressed) {
+		readAll(p,size,count,in->f,in->name);
+		return;
+	}
+	while (bytes) {
+		if (in->used == in->have)
+			nextFrame(in);
+		n = (in->have - in->used < bytes) ? in->have - in->used : bytes;
+		memcpy(dst,in->raw + in->used,n);
+		in->used += n;
+		dst += n;
+		bytes -= n;
+	}
+}
+
+static void closeSnapshot(struct SnapshotIn *in)
+{
+	fclose(in->f);
+	free(in->raw);
+	free(in->packed);
+}
+
+/**
+ * Opens a snapshot and checks its header, leaving in at the first column
+ */
+static void openSnapshot(const char *name,struct SnapshotHeader *h,struct SnapshotIn *in)
+{
+	FILE *f = fopen(name,"rb");
+	if (!f) {
+		fprintf(stderr,"[ERROR] Could not open %s.\n",name);
+		exit(1);
+	}
+	readAll(h,sizeof(*h),1,f,name);
+	if (memcmp(h->magic,SNAPSHOT_MAGIC,sizeof(h->magic))) {
+		fprintf(stderr,"[ERROR] %s is not a pond snapshot.\n",name);
+		exit(1);
+	}
+	if ((h->version != SNAPSHOT_VERSION)||(h->byteOrder != SNAPSHOT_BYTE_ORDER)||(h->wordBytes != sizeof(uintptr_t))) {
+		fprintf(stderr,"[ERROR] %s is version %u from a %u-byte-word machine; this reads version %d from this machine only.\n",
+			name,h->version,h->wordBytes,SNAPSHOT_VERSION);
+		exit(1);
+	}
+	if ((h->wordsGenome == 0)||(h->maxNumInstr > h->wordsGenome * h->wordBytes * 2)) {
+		fprintf(stderr,"[ERROR] %s has a bad genome size.\n",name);
+		exit(1);
+	}
+	fseek(f,h->headerBytes,SEEK_SET);
+	memset(in,0,sizeof(*in));
+	in->f = f;
+	in->name = name;
+	in->compressed = (h->flags & SNAPSHOT_COMPRESSED) != 0;
+}
+
+/**
+ * Reads all the metadata columns of a snapshot into newly allocated arrays
+ */
+static void readColumns(struct SnapshotIn *in,const struct SnapshotHeader *h,uint64_t *columns[SNAPSHOT_COLUMNS])
+{
+	int k;
+	for(k=0;k<SNAPSHOT_COLUMNS;++k) {
+		columns[k] = allocOrDie(h->cellCount * sizeof(uint64_t));
+		readSnapshot(in,columns[k],sizeof(uint64_t),h->cellCount);
+	}
+}
+
+/**
+ * Writes one genome of h->wordsGenome words to out as hex digits, stopping
+ * after four STOPs in a row like the old reports did
+ */
+static void writeGenome(const struct SnapshotHeader *h,const uintptr_t *genome,char *text,FILE *out)
+{
+	uintptr_t wordPtr = 0, shiftPtr = 0, inst, stopCount = 0, i, len = 0;
+	for(i=0;i<h->maxNumInstr;++i) {
+		inst = (genome[wordPtr] >> shiftPtr) & 0xf;
+		text[len++] = "0123456789abcdef"[inst];
+		if (inst == 0xf) { /* STOP */
+			if (++stopCount >= 4)
+				break;
+		} else
+			stopCount = 0;
+
+		if ((shiftPtr += 4) >= h->wordBytes * 8) {
+			if (++wordPtr >= h->wordsGenome) {
+				wordPtr = 0;
+				shiftPtr = 4;
+			} else
+				shiftPtr = 0;
+		}
+	}
+	fwrite(text,1,len,out);
+}
+
+/**
+ * Prints count cells, starting at row first of the columns, whose genomes
+ * start at genomes
+ */
+static void writeCells(const struct SnapshotHeader *h,uint64_t *columns[SNAPSHOT_COLUMNS],const uintptr_t *genomes,
+	const uint64_t first,const uint64_t count,char *text)
+{
+	uint64_t j;
+	for(j=0;j<count;++j) {
+		printf("ID: %lu, parent ID: %lu, lineage: %lu, generation: %lu\n",
+			columns[SNAPSHOT_ID][first + j],
+			columns[SNAPSHOT_PARENT_ID][first + j],
+			columns[SNAPSHOT_LINEAGE][first + j],
+			columns[SNAPSHOT_GENERATION][first + j]);
+		writeGenome(h,genomes + j * h->wordsGenome,text,stdout);
+	}
+}
+
+/**
+ * Applies the delta being read from in to a whole pond held in columns and
+ * genomes, one row per position
+ */
+static void applyDelta(struct SnapshotIn *in,const struct SnapshotHeader *d,uint64_t *columns[SNAPSHOT_COLUMNS],uintptr_t *genomes)
+{
+	uint64_t *changes[SNAPSHOT_COLUMNS], i, j, block, row;
+	const size_t genomeBytes = d->wordsGenome * sizeof(uintptr_t);
+	uintptr_t *buffer;
+	int k;
+
+	readColumns(in,d,changes);
+	block = (GENOME_BUFFER_WORDS > d->wordsGenome) ? GENOME_BUFFER_WORDS / d->wordsGenome : 1;
+	buffer = allocOrDie(block * genomeBytes);
+	for(i=0;i<d->cellCount;i+=block) {
+		if (d->cellCount - i < block)
+			block = d->cellCount - i;
+		readSnapshot(in,buffer,genomeBytes,block);
+		for(j=0;j<block;++j) {
+			row = changes[SNAPSHOT_POSITION][i + j];
+			if (row >= d->pondSizeX * d->pondSizeY) {
+				fprintf(stderr,"[ERROR] %s has a cell outside the pond.\n",in->name);
+				exit(1);
+			}
+			for(k=0;k<SNAPSHOT_COLUMNS;++k)
+				columns[k][row] = changes[k][i + j];
+			memcpy(genomes + row * d->wordsGenome,buffer + j * d->wordsGenome,genomeBytes);
+		}
+	}
+	for(k=0;k<SNAPSHOT_COLUMNS;++k)
+		free(changes[k]);
+	free(buffer);
+}
+
+int main(int argc,char **argv)
+{
+	struct SnapshotHeader h, d;
+	struct SnapshotIn in;
+	uint64_t *columns[SNAPSHOT_COLUMNS], i, block;
+	uintptr_t *genomes;
+	char *text;
+	int a;
+
+	if (argc < 2) {
+		fprintf(stderr,"Usage: %s <snapshot> [<delta> ...]\n",argv[0]);
+		return 1;
+	}
+	openSnapshot(argv[1],&h,&in);
+	if (h.flags & SNAPSHOT_DELTA) {
+		fprintf(stderr,"[ERROR] %s is a delta from clock %lu; give the keyframe it builds on first.\n",argv[1],h.baseClock);
+		return 1;
+	}
+	readColumns(&in,&h,columns);
+	text = allocOrDie(h.maxNumInstr);
+
+	if (argc == 2) {
+		/* Just this file; stream the genomes through a buffer */
+		block = (GENOME_BUFFER_WORDS > h.wordsGenome) ? GENOME_BUFFER_WORDS / h.wordsGenome : 1;
+		genomes = allocOrDie(block * h.wordsGenome * sizeof(uintptr_t));
+		for(i=0;i<h.cellCount;i+=block) {
+			if (h.cellCount - i < block)
+				block = h.cellCount - i;
+			readSnapshot(&in,genomes,h.wordsGenome * sizeof(uintptr_t),block);
+			writeCells(&h,columns,genomes,i,block,text);
+		}
+		closeSnapshot(&in);
+		return (fflush(stdout) == 0) ? 0 : 1;
+	}
+
+	if ((h.flags & ~SNAPSHOT_COMPRESSED)||(h.cellCount != h.pondSizeX * h.pondSizeY)) {
+		fprintf(stderr,"[ERROR] %s is not a keyframe, so deltas cannot be applied to it.\n",argv[1]);
+		return 1;
+	}
+	genomes = allocOrDie(h.cellCount * h.wordsGenome * sizeof(uintptr_t));
+	readSnapshot(&in,genomes,h.wordsGenome * sizeof(uintptr_t),h.cellCount);
+	closeSnapshot(&in);
+
+	for(a=2;a<argc;++a) {
+		openSnapshot(argv[a],&d,&in);
+		if ((!(d.flags & SNAPSHOT_DELTA))||(d.baseClock != h.clock)) {
+			fprintf(stderr,"[ERROR] %s is not a delta from clock %lu.\n",argv[a],h.clock);
+			return 1;
+		}
+		if ((d.pondSizeX != h.pondSizeX)||(d.pondSizeY != h.pondSizeY)||(d.wordsGenome != h.wordsGenome)||(d.maxNumInstr != h.maxNumInstr)) {
+			fprintf(stderr,"[ERROR] %s is from a pond of a different shape.\n",argv[a]);
+			return 1;
+		}
+		applyDelta(&in,&d,columns,genomes);
+		closeSnapshot(&in);
+		h.clock = d.clock;
+	}
+
+	writeCells(&h,columns,genomes,0,h.cellCount,text);
+	return (fflush(stdout) == 0) ? 0 : 1;
+}
@@ -0,0 +1,758 @@
+/* Structure-of-arrays version of parallelEdit.c.
+ *
+ * Instead of an array of 296-byte struct Cell records, every field lives in
+ * its own dense array indexed by x * POND_SIZE_Y + y (the same order as
+ * cellArray[x][y]), and all genomes live together in genomeSlab. Energy and
+ * generation are 32 bits wide. The pond-wide scans in doUpdate() and
+ * doClockUpdate() then stream just those two columns (8 bytes per cell
+ * instead of a 296-byte stride), and the compiler turns the scan into SIMD.
+ * RedrawScreen() computes a column of colors at a time the same way.
+ *
+ * The VM, picker and inflow are unchanged from parallelEdit.c, so with one
+ * thread this produces the same output as parallelEdit.c.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <signal.h>
+#ifdef USE_SDL
+#include <SDL.h>
+#endif /* USE_SDL */
+#include <omp.h>
+
+// pond constants
+#define STOP_AT 3000000
+#define UPDATE_FREQUENCY 100000
+#define REPORT_FREQUENCY 10000000
+#define CLOCKUPDATE_FREQUENCY 10000
+#define CLOCKREPORT_FREQUENCY 10000000
+#define MUTATION_RATE 21475
+#define INFLOW_FREQUENCY 100
+#define INFLOW_RATE_BASE 4000
+#define INFLOW_RATE_VARIATION 8000
+#define POND_SIZE_X 640
+#define POND_SIZE_Y 480
+#define MAX_NUM_INSTR 512
+#define FAILED_KILL_PENALTY 2
+
+#define BATCH_SIZE 100
+
+#define MAX_WORDS_GENOME (MAX_NUM_INSTR / (sizeof(uintptr_t) * 2))
+#define BITS_IN_WORD (sizeof(uintptr_t) * 8)
+#define N_LEFT 0
+#define N_RIGHT 1
+#define N_UP 2
+#define N_DOWN 3
+#define EXEC_START_WORD 0
+#define EXEC_START_BIT 4
+
+#define NUM_CELLS (POND_SIZE_X * POND_SIZE_Y)
+#define CELL(x,y) ((uintptr_t)(x) * POND_SIZE_Y + (uintptr_t)(y))
+
+// RNG variables; indexes and arrays
+// RNG functions
+#define N 624
+#define M 397
+#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
+#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
+#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
+
+static unsigned long rngArray[NUM_CELLS + 1][N];
+static int rngIndexArray[NUM_CELLS + 1];
+
+static void init_genrandArray(unsigned long s)
+{
+	int i, j;
+	for (i = 0; i < NUM_CELLS + 1; i++) {
+		rngArray[i][0] = (s) & 0xffffffffUL;
+		for (j = 1; j < N; j++) {
+			rngArray[i][j] = (1812433253UL * (rngArray[i][j-1] ^ (rngArray[i][j-1] >> 30)) + j);
+			rngArray[i][j] &= 0xffffffffUL;
+		}
+		rngIndexArray[i] = N;
+	}
+}
+
+static inline uint32_t genrand_int32Array(int whichRNG) {
+	uint32_t y;
+	static const uint32_t mag01[2]={0x0UL, MATRIX_A};
+	unsigned long *mt = rngArray[whichRNG];
+
+	if (rngIndexArray[whichRNG] >= N) { /* generate N words at one time */
+		int kk;
+		for (kk=0;kk<N-M;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		for (;kk<N-1;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
+		mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+
+		rngIndexArray[whichRNG] = 0;
+	}
+
+	y = mt[rngIndexArray[whichRNG]++];
+
+	/* Tempering */
+	y ^= (y >> 11);
+	y ^= (y << 7) & 0x9d2c5680UL;
+	y ^= (y << 15) & 0xefc60000UL;
+	y ^= (y >> 18);
+
+	return y;
+}
+
+static inline uintptr_t getRandomFromArray(int whichRNG)
+{
+	if (sizeof(uintptr_t) == 8)
+		return (uintptr_t)((((uint64_t)genrand_int32Array(whichRNG)) << 32) ^ ((uint64_t)genrand_int32Array(whichRNG)));
+	return (uintptr_t)genrand_int32Array(whichRNG);
+}
+
+//central structures
+static const uintptr_t BITS_IN_FOURBIT_WORD[16] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
+
+// The pond, one array per field. Energy never gets near 2^32 since every
+// instruction burns one unit; inflow saturates rather than wrapping anyway.
+static uint32_t energyArray[NUM_CELLS];         /* Energy level of each cell */
+static uint32_t generationArray[NUM_CELLS];     /* Generations start at 0 and are incremented from there. */
+static uint64_t parentIDArray[NUM_CELLS];       /* ID of the cell's parent */
+static uint64_t lineageArray[NUM_CELLS];        /* Equal to the cell ID of the first cell in the line. */
+static uint64_t IDArray[NUM_CELLS];             /* Globally unique cell ID */
+static uintptr_t genomeSlab[NUM_CELLS][MAX_WORDS_GENOME];/* four-bit instructions packed into machine-size words */
+
+struct PerUpdateStatCounters
+{
+	double instructionExecutions[16];/* Per-instruction-type execution count since last update. */
+	double cellExecutions;      /* Number of cells executed since last update */
+	uintptr_t viableCellsReplaced;  /* Number of viable cells replaced by other cells' offspring */
+	uintptr_t viableCellsKilled;    /* Number of viable cells KILLed */
+	uintptr_t viableCellShares; /* Number of successful SHARE operations */
+};
+
+struct PerUpdateStatCounters statCounters;
+
+#ifdef USE_SDL
+/* Currently selected color scheme */
+enum { KINSHIP,LINEAGE,MAX_COLOR_SCHEME } colorScheme = KINSHIP;
+const char *colorSchemeName[2] = { "KINSHIP", "LINEAGE" };
+#endif /* USE_SDL */
+
+/**
+ * Prints one CSV stats line. Only the energy and generation columns are
+ * read, and the loop is written without branches so it vectorizes.
+ */
+static void printStats(const uintptr_t clock, uint64_t *lastTotalViableReplicators)
+{
+	uintptr_t i;
+
+	uint64_t totalActiveCells = 0;
+	uint64_t totalEnergy = 0;
+	uint64_t totalViableReplicators = 0;
+	uint32_t maxGeneration = 0;
+
+	#pragma omp simd reduction(+:totalActiveCells,totalEnergy,totalViableReplicators) reduction(max:maxGeneration)
+	for(i=0;i<NUM_CELLS;++i) {
+		const uint32_t e = energyArray[i];
+		const uint32_t g = (e != 0) ? generationArray[i] : 0;
+		totalActiveCells += (e != 0);
+		totalEnergy += e;
+		totalViableReplicators += (g > 2);
+		maxGeneration = (g > maxGeneration) ? g : maxGeneration;
+	}
+
+	/* Look here to get the columns in the CSV output */
+	/* The first five are here and are self-explanatory */
+	printf("%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+		(uint64_t)clock,
+		(uint64_t)totalEnergy,
+		(uint64_t)totalActiveCells,
+		(uint64_t)totalViableReplicators,
+		(uint64_t)maxGeneration,
+		(uint64_t)statCounters.viableCellsReplaced,
+		(uint64_t)statCounters.viableCellsKilled,
+		(uint64_t)statCounters.viableCellShares
+	);
+
+	/* The next 16 are the average frequencies of execution for each instruction per cell execution. */
+	double totalMetabolism = 0.0;
+	for(i=0;i<16;++i) {
+		totalMetabolism += statCounters.instructionExecutions[i];
+		printf(",%.4f",
+			(statCounters.cellExecutions > 0.0)
+			? (statCounters.instructionExecutions[i] / statCounters.cellExecutions)
+			: 0.0);
+	}
+
+	/* The last column is the average metabolism per cell execution */
+	printf(",%.4f\n",
+			(statCounters.cellExecutions > 0.0)
+			? (totalMetabolism / statCounters.cellExecutions)
+			: 0.0);
+	fflush(stdout);
+
+	if ((*lastTotalViableReplicators > 0)&&(totalViableReplicators == 0))
+		fprintf(stderr,
+			"[EVENT] Viable replicators have gone extinct. "\
+			"Please reserve a moment of silence.\n");
+	else
+		if ((*lastTotalViableReplicators == 0)&&(totalViableReplicators > 0))
+			fprintf(stderr,"[EVENT] Viable replicators have appeared!\n");
+
+	*lastTotalViableReplicators = totalViableReplicators;
+
+	/* Reset per-update stat counters */
+	memset(&statCounters,0,sizeof(statCounters));
+}
+
+static void doClockUpdate(const uintptr_t clock)
+{
+	static uint64_t lastTotalViableReplicators = 0;
+	printStats(clock,&lastTotalViableReplicators);
+}
+
+static void doUpdate(const uintptr_t clock)
+{
+	static uint64_t lastTotalViableReplicators = 0;
+	printStats(clock,&lastTotalViableReplicators);
+}
+
+/**
+ * Writes every cell (viableOnly == 0) or every viable cell to a report file.
+ */
+static void writeReport(const char *prefix, const uintptr_t clock, const int viableOnly)
+{
+	char buf[MAX_NUM_INSTR*2];
+	FILE *d;
+	uintptr_t c,wordPtr,shiftPtr,inst,stopCount,i;
+
+	sprintf(buf,"%s%lu.report.csv",prefix,clock);
+	d = fopen(buf,"w");
+	if (!d) {
+		fprintf(stderr,"[WARNING] Could not open %s for writing.\n",buf);
+		return;
+	}
+
+	fprintf(stderr,"[INFO] Reporting viable cells to %s\n",buf);
+
+	for(c=0;c<NUM_CELLS;++c) {
+		if (viableOnly && !(energyArray[c]&&(generationArray[c] > 2)))
+			continue;
+		fprintf(d,"ID: %lu, parent ID: %lu, lineage: %lu, generation: %lu\n",
+			(uint64_t)IDArray[c],
+			(uint64_t)parentIDArray[c],
+			(uint64_t)lineageArray[c],
+			(uint64_t)generationArray[c]);
+		wordPtr = 0;
+		shiftPtr = 0;
+		stopCount = 0;
+		for(i=0;i<MAX_NUM_INSTR;++i) {
+			inst = (genomeSlab[c][wordPtr] >> shiftPtr) & 0xf;
+			/* Four STOP instructions in a row is considered the end. */
+			fprintf(d,"%lx",inst);
+			if (inst == 0xf) { /* STOP */
+				if (++stopCount >= 4)
+					break;
+			} else
+				stopCount = 0;
+
+			if ((shiftPtr += 4) >= BITS_IN_WORD) {
+				if (++wordPtr >= MAX_WORDS_GENOME) {
+					wordPtr = 0;
+					shiftPtr = 4;
+				} else
+					shiftPtr = 0;
+			}
+		}
+	}
+	fclose(d);
+}
+
+static void doClockReport(const uintptr_t clock)
+{
+	writeReport("c",clock,0);
+}
+
+static void doReport(const uintptr_t clock)
+{
+	writeReport("p",clock,1);
+}
+
+/**
+ * Get the index of a neighbor in the pond
+ */
+static inline uintptr_t getNeighbor(const uintptr_t x,const uintptr_t y,const uintptr_t dir)
+{
+	/* Space is toroidal; it wraps at edges */
+	switch(dir) {
+		case N_LEFT: 	return (x) ? CELL(x-1,y) : CELL(POND_SIZE_X-1,y);
+		case N_RIGHT: 	return (x < (POND_SIZE_X-1)) ? CELL(x+1,y) : CELL(0,y);
+		case N_UP: 	return (y) ? CELL(x,y-1) : CELL(x,POND_SIZE_Y-1);
+		case N_DOWN: 	return (y < (POND_SIZE_Y-1)) ? CELL(x,y+1) : CELL(x,0);
+	}
+	return CELL(x,y); /* This should never be reached */
+}
+
+/**
+ * Determines if c1 is allowed to access c2
+ */
+static inline int accessAllowed(const uintptr_t c2,const uintptr_t c1guess,int sense, int currRNG)
+{
+	/* Access permission is more probable if they are more similar in sense 0,
+	* and more probable if they are different in sense 1. Sense 0 is used for
+	* "negative" interactions and sense 1 for "positive" ones. */
+	return sense
+		? (((getRandomFromArray(currRNG) & 0xf) >=
+			BITS_IN_FOURBIT_WORD[(genomeSlab[c2][0] & 0xf) ^ (c1guess & 0xf)])||(!parentIDArray[c2]))
+		: (((getRandomFromArray(currRNG) & 0xf) <=
+			BITS_IN_FOURBIT_WORD[(genomeSlab[c2][0] & 0xf) ^ (c1guess & 0xf)])||(!parentIDArray[c2]));
+}
+
+#ifdef USE_SDL
+/**
+ * Kinship hue of a genome, as in multipleRNGserial.c. Only called for cells
+ * that the column pass in RedrawScreen() found to be alive and of
+ * generation > 1.
+ */
+static inline uint32_t kinshipColor(const uintptr_t c)
+{
+	uintptr_t i,j,word,sum = 0,opcode,skipnext = 0;
+
+	for(i=0;i<MAX_WORDS_GENOME&&(genomeSlab[c][i] != ~((uintptr_t)0));++i) {
+		word = genomeSlab[c][i];
+		for(j=0;j<BITS_IN_WORD/4;++j,word >>= 4) {
+			/* We ignore 0xf's here, because otherwise very similar genomes
+			* might get quite different hash values in the case when one of
+			* the genomes is slightly longer and uses one more maschine
+			* word. */
+			opcode = word & 0xf;
+			if (skipnext)
+				skipnext = 0;
+			else {
+				if (opcode != 0xf)
+					sum += opcode;
+				if (opcode == 0xc) /* 0xc == XCHG */
+					skipnext = 1; /* Skip "operand" after XCHG */
+			}
+		}
+	}
+	return (uint32_t)((sum % 192) + 64)*256*256*256;
+}
+
+static SDL_Event       sdlEvent;               // keyboard, mouse, etc.
+static SDL_Window*     sdlWindow;
+static SDL_Renderer*   sdlRenderer;
+static SDL_Texture*    sdlTexture;
+static void*           myPixels;               // Filled in by SDL_LockTexture()
+static int             sdlPitch;               // Filled in by SDL_LockTexture()
+
+static void Initialize_SDL2(){
+	if( SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO | SDL_INIT_EVENTS) ){
+		fprintf(stderr, "%s::%d Error in SDL_Init\n%s\n",
+				__FILE__, __LINE__, SDL_GetError());
+		exit(-1);
+	}
+	atexit(SDL_Quit);
+
+	if( SDL_CreateWindowAndRenderer(POND_SIZE_X,POND_SIZE_Y,
+		SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED,&sdlWindow,&sdlRenderer) ){
+		fprintf(stderr, "%s::%d Error in SDL_CreateWindowAndRenderer\n%s\n",
+				__FILE__, __LINE__, SDL_GetError());
+		exit(-1);
+	}
+	SDL_SetWindowTitle(sdlWindow, "Nanopond");
+
+	sdlTexture = SDL_CreateTexture(sdlRenderer,SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,POND_SIZE_X,POND_SIZE_Y);
+	if(sdlTexture == NULL){
+		fprintf(stderr, "%s::%d Error in SDL_CreateTexture()\n%s\n",
+				__FILE__, __LINE__, SDL_GetError());
+		exit(-1);
+	}
+}
+
+/**
+ * Redraws the pond one x column at a time, since that is the order the
+ * field arrays are stored in. The first pass over a column reads only the
+ * energy, generation and lineage arrays and vectorizes; genomes are only
+ * touched for the cells the kinship scheme actually colors.
+ */
+static void RedrawScreen(){
+	uint32_t column[POND_SIZE_Y];
+	uintptr_t x,y;
+
+	if( SDL_LockTexture(sdlTexture,NULL,&myPixels,&sdlPitch) ){
+		fprintf(stderr, "%s::%d Error in SDL_LockTexture\n%s\n",
+				__FILE__, __LINE__, SDL_GetError());
+		exit(-1);
+	}
+
+	for (x=0;x<POND_SIZE_X;++x) {
+		const uint32_t *e = &energyArray[CELL(x,0)];
+		const uint32_t *g = &generationArray[CELL(x,0)];
+		const uint64_t *l = &lineageArray[CELL(x,0)];
+
+		if (colorScheme == LINEAGE) {
+			#pragma omp simd
+			for (y=0;y<POND_SIZE_Y;++y)
+				column[y] = (e[y] && (g[y] > 1)) ? (((uint32_t)l[y]) | (uint32_t)1) : 0;
+		} else {
+			#pragma omp simd
+			for (y=0;y<POND_SIZE_Y;++y)
+				column[y] = (e[y] && (g[y] > 1));
+			for (y=0;y<POND_SIZE_Y;++y) {
+				if (column[y])
+					column[y] = kinshipColor(CELL(x,y));
+			}
+		}
+		for (y=0;y<POND_SIZE_Y;++y)
+			((uint32_t *)((uint8_t *)myPixels + y * sdlPitch))[x] = column[y];
+	}
+
+	SDL_UnlockTexture( sdlTexture );
+	SDL_RenderClear(sdlRenderer);
+	SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, NULL);
+	SDL_RenderPresent(sdlRenderer);
+}
+#endif /* USE_SDL */
+
+//array of locations where the threads can go to get the location of a random cell
+unsigned long randomLocationX[BATCH_SIZE];
+unsigned long randomLocationY[BATCH_SIZE];
+
+int cellPickIndex = NUM_CELLS;
+
+void pickBatch() {
+	int i;
+	for (i = 0; i < BATCH_SIZE; i++) {
+		// The first pair is discarded, as in parallelEdit.c
+		int x = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
+		int y = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
+		x = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
+		y = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
+
+		randomLocationX[i] = x;
+		randomLocationY[i] = y;
+	}
+}
+
+int executeCell(int x, int y) {
+	const uintptr_t currCell = CELL(x,y);
+	if (!energyArray[currCell]) {
+		return 0;
+	}
+
+	uintptr_t ptr_wordPtr = 0;
+	uintptr_t ptr_shiftPtr = 0;
+	uintptr_t reg = 0;
+	uintptr_t loopStack_wordPtr[MAX_NUM_INSTR];
+	uintptr_t loopStack_shiftPtr[MAX_NUM_INSTR];
+	uintptr_t loopStackPtr = 0;
+	uintptr_t wordPtr = EXEC_START_WORD;
+	uintptr_t shiftPtr = EXEC_START_BIT;
+	uintptr_t facing = 0;
+	uintptr_t falseLoopDepth = 0;
+	int stop = 0;
+	uintptr_t currentWord;
+	uintptr_t inst, tmp;
+	uintptr_t *const genome = genomeSlab[currCell];
+	uintptr_t neighborCell = getNeighbor(x, y, facing);
+
+	int currRNG = x + POND_SIZE_X * y;
+	currentWord = genome[0];
+
+	int i;
+	uintptr_t outputBuf[MAX_WORDS_GENOME];
+	for(i=0;i<MAX_WORDS_GENOME;++i)
+		outputBuf[i] = ~((uintptr_t)0);
+	uint64_t instrExecs[16] = {0};
+	uint64_t cellsReplaced = 0;
+	uint64_t cellsKilled = 0;
+	uint64_t cellsShared = 0;
+
+	while (energyArray[currCell]&&(!stop)) {
+		inst = (currentWord >> shiftPtr) & 0xf;
+		instrExecs[inst] += 1.0;
+
+		if ((getRandomFromArray(currRNG) & 0xffffffff) < MUTATION_RATE) {
+			tmp = getRandomFromArray(currRNG);
+			if (tmp & 0x80) // Check for the 8th bit to get random boolean //
+				inst = tmp & 0xf; // Only the first four bits are used here //
+			else reg = tmp & 0xf;
+		}
+
+		--energyArray[currCell];
+
+		if (falseLoopDepth) {
+			if (inst == 0x9)
+				++falseLoopDepth;
+			else if (inst == 0xa)
+				--falseLoopDepth;
+		} else {
+			switch(inst) {
+				case 0x0: // ZERO: Zero VM state registers //
+					reg = 0;
+					ptr_wordPtr = 0;
+					ptr_shiftPtr = 0;
+					facing = 0;
+					break;
+				case 0x1: // FWD: Increment the pointer (wrap at end) //
+					if ((ptr_shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++ptr_wordPtr >= MAX_WORDS_GENOME)
+							ptr_wordPtr = 0;
+						ptr_shiftPtr = 0;
+					}
+					break;
+				case 0x2: // BACK: Decrement the pointer (wrap at beginning) //
+					if (ptr_shiftPtr)
+						ptr_shiftPtr -= 4;
+					else {
+						if (ptr_wordPtr)
+							--ptr_wordPtr;
+						else ptr_wordPtr = MAX_WORDS_GENOME - 1;
+						ptr_shiftPtr = BITS_IN_WORD - 4;
+					}
+					break;
+				case 0x3: // INC: Increment the register //
+					reg = (reg + 1) & 0xf;
+					break;
+				case 0x4: // DEC: Decrement the register //
+					reg = (reg - 1) & 0xf;
+					break;
+				case 0x5: // READG: Read into the register from genome //
+					reg = (genome[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x6: // WRITEG: Write out from the register to genome //
+					genome[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					genome[ptr_wordPtr] |= reg << ptr_shiftPtr;
+					currentWord = genome[wordPtr]; // Must refresh in case this changed! //
+					break;
+				case 0x7: // READB: Read into the register from buffer //
+					reg = (outputBuf[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x8: // WRITEB: Write out from the register to buffer //
+					outputBuf[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					outputBuf[ptr_wordPtr] |= reg << ptr_shiftPtr;
+					break;
+				case 0x9: // LOOP: Jump forward to matching REP if register is zero //
+					if (reg) {
+						if (loopStackPtr >= MAX_NUM_INSTR)
+							stop = 1; // Stack overflow ends execution //
+						else {
+							loopStack_wordPtr[loopStackPtr] = wordPtr;
+							loopStack_shiftPtr[loopStackPtr] = shiftPtr;
+							++loopStackPtr;
+						}
+					} else falseLoopDepth = 1;
+					break;
+				case 0xa: // REP: Jump back to matching LOOP if register is nonzero //
+					if (loopStackPtr) {
+						--loopStackPtr;
+						if (reg) {
+							wordPtr = loopStack_wordPtr[loopStackPtr];
+							shiftPtr = loopStack_shiftPtr[loopStackPtr];
+							currentWord = genome[wordPtr];
+							// This ensures that the LOOP is rerun //
+							continue;
+						}
+					}
+					break;
+				case 0xb: // TURN: Turn in the direction specified by register //
+					facing = reg & 3;
+					break;
+				case 0xc: // XCHG: Skip next instruction and exchange value of register with it //
+					if ((shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++wordPtr >= MAX_WORDS_GENOME) {
+							wordPtr = EXEC_START_WORD;
+							shiftPtr = EXEC_START_BIT;
+						} else shiftPtr = 0;
+					}
+					tmp = reg;
+					reg = (genome[wordPtr] >> shiftPtr) & 0xf;
+					genome[wordPtr] &= ~(((uintptr_t)0xf) << shiftPtr);
+					genome[wordPtr] |= tmp << shiftPtr;
+					currentWord = genome[wordPtr];
+					break;
+				case 0xd: // KILL: Blow away neighboring cell if allowed with penalty on failure //
+					neighborCell = getNeighbor(x,y,facing);
+					if (accessAllowed(neighborCell,reg,0,currRNG)) {
+						if (generationArray[neighborCell] > 2)
+							++cellsKilled;
+
+						// Filling first two words with 0xfffff... is enough //
+						genomeSlab[neighborCell][0] = ~((uintptr_t)0);
+						genomeSlab[neighborCell][1] = ~((uintptr_t)0);
+						parentIDArray[neighborCell] = 0;
+						generationArray[neighborCell] = 0;
+					} else if (generationArray[neighborCell] > 2) {
+						tmp = energyArray[currCell] / FAILED_KILL_PENALTY;
+						if (energyArray[currCell] > tmp)
+							energyArray[currCell] -= tmp;
+						else energyArray[currCell] = 0;
+					}
+					break;
+				case 0xe: // SHARE: Equalize energy between self and neighbor if allowed //
+					neighborCell = getNeighbor(x,y,facing);
+					if (accessAllowed(neighborCell,reg,1,currRNG)) {
+						if (generationArray[neighborCell] > 2)
+							++cellsShared;
+
+						tmp = (uintptr_t)energyArray[currCell] + energyArray[neighborCell];
+						energyArray[neighborCell] = (uint32_t)(tmp / 2);
+						energyArray[currCell] = (uint32_t)(tmp - energyArray[neighborCell]);
+					}
+					break;
+				case 0xf: // STOP: End execution //
+					stop = 1;
+					break;
+			} // end switch
+		} // end else for falseLoopDepth
+
+		if ((shiftPtr += 4) >= BITS_IN_WORD) {
+			if (++wordPtr >= MAX_WORDS_GENOME) {
+				wordPtr = EXEC_START_WORD;
+				shiftPtr = EXEC_START_BIT;
+			} else shiftPtr = 0;
+			currentWord = genome[wordPtr];
+		} // end if
+	} // end while
+
+	if ((outputBuf[0] & 0xff) != 0xff) {
+		if ((energyArray[neighborCell])&&accessAllowed(neighborCell,reg,0,currRNG)) {
+			if (generationArray[neighborCell] > 2)
+				++cellsReplaced;
+
+			parentIDArray[neighborCell] = IDArray[currCell];
+			lineageArray[neighborCell] = lineageArray[currCell];
+			generationArray[neighborCell] = generationArray[currCell] + 1;
+			memcpy(genomeSlab[neighborCell],outputBuf,sizeof(outputBuf));
+		}
+	}
+
+	#pragma omp critical
+	{
+		for (i = 0; i < 16; i++) {
+			statCounters.instructionExecutions[i] += instrExecs[i];
+		}
+		statCounters.viableCellsReplaced += cellsReplaced;
+		statCounters.viableCellsKilled += cellsKilled;
+		statCounters.viableCellShares += cellsShared;
+	}
+	return 1;
+}
+
+void initializePond() {
+	uintptr_t c, i;
+	// Clear pond and initialize to blank cells
+	memset(energyArray,0,sizeof(energyArray));
+	memset(generationArray,0,sizeof(generationArray));
+	memset(parentIDArray,0,sizeof(parentIDArray));
+	memset(lineageArray,0,sizeof(lineageArray));
+	memset(IDArray,0,sizeof(IDArray));
+	for(c=0;c<NUM_CELLS;++c) {
+		for(i=0;i<MAX_WORDS_GENOME;++i)
+			genomeSlab[c][i] = ~((uintptr_t)0);
+	}
+
+	// Seeding and initializing cell picker RNG
+	init_genrandArray(1234567890);
+	for(i=0;i<1024;++i)
+		getRandomFromArray(cellPickIndex);
+}
+
+//main
+int main()  {
+	struct timeval runStart, runStop;
+	gettimeofday(&runStart, NULL);
+
+	int i,j,x,y;
+	uintptr_t currCell, energy;
+	uintptr_t clock = 0;
+	uint64_t cellIDCounter = 0;
+
+	// Sets all cell attributes to 0 and seeds RNGs
+	initializePond();
+
+#ifdef USE_SDL
+	Initialize_SDL2();
+	RedrawScreen();
+#endif /* USE_SDL */
+
+	// Batch execution loop
+	for (;;){
+		// picking next BATCH_SIZE random locations to execute
+		pickBatch();
+
+// Parallel for loop to execute each cell
+#pragma omp parallel private(i)
+{
+		#pragma omp for
+		for (i = 0; i < BATCH_SIZE; i++)
+			executeCell(randomLocationX[i], randomLocationY[i]);
+}
+
+		// Increment clock and number of cell executions by batch size
+		clock += BATCH_SIZE;
+		statCounters.cellExecutions += BATCH_SIZE;
+
+		// Introduce random cell with energy. Do this as many times as needed relative to batch size.
+		for (i = 0; i < BATCH_SIZE / INFLOW_FREQUENCY; i++) {
+			x = getRandomFromArray(cellPickIndex) % POND_SIZE_X;
+			y = getRandomFromArray(cellPickIndex) % POND_SIZE_Y;
+			currCell = CELL(x,y);
+			IDArray[currCell] = cellIDCounter;
+			parentIDArray[currCell] = 0;
+			lineageArray[currCell] = cellIDCounter;
+			generationArray[currCell] = 0;
+#ifdef INFLOW_RATE_VARIATION
+			energy = energyArray[currCell] + INFLOW_RATE_BASE + (getRandomFromArray(NUM_CELLS) % INFLOW_RATE_VARIATION);
+#else
+			energy = energyArray[currCell] + INFLOW_RATE_BASE;
+#endif
+			energyArray[currCell] = (energy > UINT32_MAX) ? UINT32_MAX : (uint32_t)energy;
+			for(j=0;j<MAX_WORDS_GENOME;++j)
+				genomeSlab[currCell][j] = getRandomFromArray(NUM_CELLS);
+			++cellIDCounter;
+		}
+
+#ifdef STOP_AT
+		if ((clock >= STOP_AT)) {
+			gettimeofday(&runStop, NULL);
+			printf("run start: %lf run stop: %lf difference: %lf \n", (float) runStart.tv_sec, (float) runStop.tv_sec, (runStop.tv_sec - runStart.tv_sec) + (runStop.tv_usec - runStart.tv_usec)/1000000.0);
+			exit(0);
+		}
+#endif
+
+		// Do updates and reports at defined intervals
+		if (!(clock % CLOCKUPDATE_FREQUENCY))
+			doClockUpdate(clock);
+		if (!(clock % CLOCKREPORT_FREQUENCY))
+			doClockReport(clock);
+		if (!(clock % UPDATE_FREQUENCY)) {
+			doUpdate(clock);
+#ifdef USE_SDL
+			while (SDL_PollEvent(&sdlEvent)) {
+				if (sdlEvent.type == SDL_QUIT) {
+					fprintf(stderr,"[QUIT] Quit signal received!\n");
+					exit(0);
+				} else if ((sdlEvent.type == SDL_MOUSEBUTTONDOWN)&&(sdlEvent.button.button == SDL_BUTTON_RIGHT)) {
+					colorScheme = (colorScheme + 1) % MAX_COLOR_SCHEME;
+					fprintf(stderr,"[INTERFACE] Switching to color scheme \"%s\".\n",colorSchemeName[colorScheme]);
+				}
+			}
+			RedrawScreen();
+#endif /* USE_SDL */
+		}
+		if (!(clock % REPORT_FREQUENCY))
+			doReport(clock);
+	} // end batch execution loop
+	exit(0);
+}
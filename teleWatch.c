@@ -0,0 +1,201 @@
+/* Reads the live telemetry parallelEdit.c publishes with -t and prints it:
+ *
+ *   telewatch /nanopond
+ *
+ * With -i it keeps reading every so many seconds until the run exits,
+ * printing each new batch it sees; with -c as well it prints one CSV row per
+ * batch instead, for recording:
+ *
+ *   telewatch -c -i 1 /nanopond > run.telemetry.csv
+ *
+ * Reading never slows the run down; see telemetry.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "telemetry.h"
+
+static const char *const INSTRUCTION_NAMES[16] = {
+	"ZERO","FWD","BACK","INC","DEC","READG","WRITEG","READB",
+	"WRITEB","LOOP","REP","TURN","XCHG","KILL","SHARE","STOP"
+};
+
+/**
+ * Maps a telemetry segment read-only and checks its header
+ */
+static const struct Telemetry *openTelemetry(const char *name,size_t *bytes)
+{
+	const struct Telemetry *t;
+	struct stat st;
+	int fd = shm_open(name,O_RDONLY,0);
+	if ((fd < 0)||(fstat(fd,&st))) {
+		fprintf(stderr,"[ERROR] Could not open shared memory segment %s.\n",name);
+		exit(1);
+	}
+	if ((size_t)st.st_size < sizeof(struct Telemetry)) {
+		fprintf(stderr,"[ERROR] %s is not a telemetry segment.\n",name);
+		exit(1);
+	}
+	t = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if (t == MAP_FAILED) {
+		fprintf(stderr,"[ERROR] Could not map shared memory segment %s.\n",name);
+		exit(1);
+	}
+	if (memcmp(t->magic,TELEMETRY_MAGIC,sizeof(t->magic))) {
+		fprintf(stderr,"[ERROR] %s is not a telemetry segment, or its writer is still starting.\n",name);
+		exit(1);
+	}
+	atomic_thread_fence(memory_order_acquire);
+	if ((t->version != TELEMETRY_VERSION)||(t->headerBytes != sizeof(struct Telemetry))||(t->threadBytes != sizeof(struct TelemetryThread))) {
+		fprintf(stderr,"[ERROR] %s is telemetry version %u; this reads version %d.\n",name,t->version,TELEMETRY_VERSION);
+		exit(1);
+	}
+	*bytes = sizeof(struct Telemetry) + t->threads * sizeof(struct TelemetryThread);
+	if ((size_t)st.st_size < *bytes) {
+		fprintf(stderr,"[ERROR] %s is truncated.\n",name);
+		exit(1);
+	}
+	return t;
+}
+
+/**
+ * Copies a consistent view of the segment into copy, retrying while the
+ * writer is in the middle of publishing
+ */
+static void readTelemetry(const struct Telemetry *t,struct Telemetry *copy,const size_t bytes)
+{
+	const struct timespec pause = { 0, 100000 };
+	uint64_t before, after;
+	for(;;) {
+		before = atomic_load_explicit(&t->sequence,memory_order_acquire);
+		if (!(before & 1)) {
+			memcpy(copy,t,bytes);
+			atomic_thread_fence(memory_order_acquire);
+			after = atomic_load_explicit(&t->sequence,memory_order_relaxed);
+			if (before == after)
+				return;
+		}
+		nanosleep(&pause,NULL);
+	}
+}
+
+static void writeReport(const struct Telemetry *t)
+{
+	uint64_t executions = 0;
+	uint32_t x;
+
+	printf("clock %lu after %lu batches; last batch %.1f ms, %.0f executions/s overall\n",
+		t->clock,t->batches,t->batchNanoseconds / 1e6,
+		(t->runNanoseconds > 0) ? t->clock / (t->runNanoseconds / 1e9) : 0.0);
+	printf("energy %lu, active %lu, viable %lu, max generation %lu, %lu genotypes (dominant %016lx)\n",
+		t->energy,t->activeCells,t->viableReplicators,t->maxGeneration,t->genotypes,t->dominantGenotype);
+	printf("since the last update: %lu executions, %lu viable replaced, %lu viable killed, %lu shares\n",
+		t->cellExecutions,t->viableCellsReplaced,t->viableCellsKilled,t->viableCellShares);
+	for(x=0;x<16;++x)
+		printf("%s%s %.4f",x ? ", " : "  ",INSTRUCTION_NAMES[x],
+			t->cellExecutions ? (double)t->instructionExecutions[x] / (double)t->cellExecutions : 0.0);
+	printf("\n");
+	for(x=0;x<t->threads;++x)
+		executions += t->thread[x].cellExecutions;
+	for(x=0;x<t->threads;++x)
+		printf("thread %u: %lu executions (%.1f%%), %lu instructions, %lu offspring\n",x,
+			t->thread[x].cellExecutions,executions ? 100.0 * t->thread[x].cellExecutions / executions : 0.0,
+			t->thread[x].instructions,t->thread[x].offspring);
+	fflush(stdout);
+}
+
+static void writeHeaderCSV(const struct Telemetry *t)
+{
+	uint32_t x;
+	printf("clock,runNanoseconds,batchNanoseconds,energy,activeCells,viableReplicators,maxGeneration,genotypes,"
+		"updateExecutions,viableCellsReplaced,viableCellsKilled,viableCellShares");
+	for(x=0;x<16;++x)
+		printf(",%s",INSTRUCTION_NAMES[x]);
+	for(x=0;x<t->threads;++x)
+		printf(",thread%uExecutions,thread%uInstructions,thread%uOffspring",x,x,x);
+	printf("\n");
+}
+
+static void writeCSV(const struct Telemetry *t)
+{
+	uint32_t x;
+	printf("%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+		t->clock,t->runNanoseconds,t->batchNanoseconds,t->energy,t->activeCells,t->viableReplicators,
+		t->maxGeneration,t->genotypes,t->cellExecutions,t->viableCellsReplaced,t->viableCellsKilled,t->viableCellShares);
+	for(x=0;x<16;++x)
+		printf(",%lu",t->instructionExecutions[x]);
+	for(x=0;x<t->threads;++x)
+		printf(",%lu,%lu,%lu",t->thread[x].cellExecutions,t->thread[x].instructions,t->thread[x].offspring);
+	printf("\n");
+	fflush(stdout);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,"Usage: %s [-i seconds] [-c] <segment name>\n"
+		"  -i  keep reading at this interval until the run exits\n"
+		"  -c  print CSV rows instead of a report\n",prog);
+}
+
+int main(int argc,char **argv)
+{
+	const struct Telemetry *segment;
+	struct Telemetry *copy;
+	struct timespec pause;
+	double interval = 0.0;
+	uint64_t lastBatches = 0;
+	size_t bytes;
+	int opt, csv = 0, exited = 0;
+
+	while ((opt = getopt(argc,argv,"i:ch")) != -1) {
+		switch (opt) {
+			case 'i': interval = atof(optarg); break;
+			case 'c': csv = 1; break;
+			default: usage(argv[0]); return (opt == 'h') ? 0 : 1;
+		}
+	}
+	if ((optind != argc - 1)||(interval < 0.0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	segment = openTelemetry(argv[optind],&bytes);
+	if (!(copy = malloc(bytes))) {
+		fprintf(stderr,"[ERROR] Out of memory.\n");
+		return 1;
+	}
+	pause.tv_sec = (time_t)interval;
+	pause.tv_nsec = (long)((interval - pause.tv_sec) * 1e9);
+
+	readTelemetry(segment,copy,bytes);
+	if (csv)
+		writeHeaderCSV(copy);
+	for(;;) {
+		if (copy->batches != lastBatches) {
+			if (csv)
+				writeCSV(copy);
+			else writeReport(copy);
+			lastBatches = copy->batches;
+		}
+		if ((interval == 0.0)||(exited))
+			break;
+		/* The segment outlives its writer; once that is gone, take one last look */
+		if ((kill((pid_t)copy->pid,0))&&(errno == ESRCH))
+			exited = 1;
+		else nanosleep(&pause,NULL);
+		readTelemetry(segment,copy,bytes);
+	}
+	if (exited)
+		fprintf(stderr,"[INFO] The run has exited.\n");
+	return (fflush(stdout) == 0) ? 0 : 1;
+}
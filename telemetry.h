@@ -0,0 +1,62 @@
+/* Live telemetry, published by parallelEdit.c into a POSIX shared memory
+ * segment when run with -t (see publishTelemetry()) and read by
+ * teleWatch.c.
+ *
+ * The segment is one Telemetry followed by a TelemetryThread for each of
+ * its threads. The writer republishes everything after sequence once a
+ * batch, seqlock style: it makes sequence odd, writes, then makes it even
+ * again. A reader copies the segment between two loads of sequence and
+ * keeps the copy only if both loads saw the same even value; otherwise it
+ * tries again. Readers never block the writer. Everything is in the byte
+ * order of the machine that wrote it, which is the machine reading it. */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC "NPTELEM"       /* Eight bytes with the terminator */
+#define TELEMETRY_VERSION 1
+
+/* Per-thread totals since the run started */
+struct TelemetryThread {
+	uint64_t cellExecutions;        /* Picks that found a cell with energy */
+	uint64_t instructions;
+	uint64_t offspring;
+};
+
+struct Telemetry {
+	char magic[8];                  /* TELEMETRY_MAGIC */
+	uint32_t version;               /* TELEMETRY_VERSION */
+	uint32_t headerBytes;           /* sizeof(struct Telemetry); threads start here */
+	uint32_t threadBytes;           /* sizeof(struct TelemetryThread) */
+	uint32_t threads;
+	uint64_t pondSizeX;
+	uint64_t pondSizeY;
+	uint64_t pid;                   /* Of the writer */
+	_Atomic uint64_t sequence;      /* Odd while the rest is being written */
+
+	uint64_t clock;
+	uint64_t batches;
+	uint64_t batchNanoseconds;      /* Wall time of the last batch */
+	uint64_t runNanoseconds;        /* Wall time since the run started */
+	uint64_t energy;
+	uint64_t activeCells;
+	uint64_t viableReplicators;
+	uint64_t maxGeneration;
+	uint64_t genotypes;
+	uint64_t dominantGenotype;
+
+	/* Since the last update, like the CSV line: divide by cellExecutions for
+	 * the per-execution instruction frequencies it prints */
+	uint64_t cellExecutions;
+	uint64_t viableCellsReplaced;
+	uint64_t viableCellsKilled;
+	uint64_t viableCellShares;
+	uint64_t instructionExecutions[16];
+
+	struct TelemetryThread thread[];
+};
+
+#endif /* TELEMETRY_H */
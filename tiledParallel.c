@@ -0,0 +1,1082 @@
+/* Shared memory version of nanopond where no two threads ever write the
+ * same cell.
+ *
+ * The pond is cut into TILE_SIZE x TILE_SIZE tiles and every OpenMP thread
+ * owns a fixed range of them. A thread only ever picks and executes cells
+ * in its own tiles. When KILL, SHARE or offspring placement reaches into a
+ * tile owned by another thread, the effect is posted as a message to that
+ * tile's mailbox, a lock-free multiple producer / single consumer stack.
+ * The owner applies its mailboxes before its next pick, then hands each
+ * message back to the worker that sent it for reuse, so no message goes
+ * through the general heap once a worker has enough of them. Reads of foreign
+ * cells (accessAllowed() and the energy check before placing offspring) are
+ * plain unsynchronized reads, as they are in parallelEdit.c.
+ *
+ * Cells are stored tile by tile so a tile is one contiguous block of
+ * memory, and only its owner writes the cache lines in it.
+ *
+ * Threads run BATCH_SIZE picks between them, then meet at a barrier to
+ * drain the mailboxes, add inflow and do updates and reports.
+ *
+ * Each worker clears its own tiles and seeds their RNGs at startup, so on a
+ * multi-socket node the pages of a tile are first touched by its owner.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <stdatomic.h>
+#include <omp.h>
+#ifdef USE_NUMA
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <numa.h>
+#include <numaif.h>
+#endif /* USE_NUMA */
+
+// pond constants
+#define STOP_AT 3000000
+#define UPDATE_FREQUENCY 100000
+#define REPORT_FREQUENCY 10000000
+#define MUTATION_RATE 21475
+#define INFLOW_FREQUENCY 100
+#define INFLOW_RATE_BASE 4000
+#define INFLOW_RATE_VARIATION 8000
+#define POND_SIZE_X 640
+#define POND_SIZE_Y 480
+#define MAX_NUM_INSTR 512
+#define FAILED_KILL_PENALTY 2
+
+// picks per batch across all threads
+#define BATCH_SIZE 10000
+
+// tile edge in cells; must divide both pond dimensions
+#define TILE_SIZE 32
+
+// Define USE_NUMA (make tiled-numa) to pin workers to CPUs node by node and
+// report which node the pond's pages landed on. The pages are placed by
+// first touch from the owning worker unless NUMA_INTERLEAVE is also set,
+// which spreads them round robin over all nodes with mbind().
+//#define NUMA_INTERLEAVE 1
+
+#define MAX_WORDS_GENOME (MAX_NUM_INSTR / (sizeof(uintptr_t) * 2))
+#define BITS_IN_WORD (sizeof(uintptr_t) * 8)
+#define N_LEFT 0
+#define N_RIGHT 1
+#define N_UP 2
+#define N_DOWN 3
+#define EXEC_START_WORD 0
+#define EXEC_START_BIT 4
+
+#define TILES_X (POND_SIZE_X / TILE_SIZE)
+#define TILES_Y (POND_SIZE_Y / TILE_SIZE)
+#define NUM_TILES (TILES_X * TILES_Y)
+#define TILE_CELLS (TILE_SIZE * TILE_SIZE)
+
+#if (POND_SIZE_X % TILE_SIZE) || (POND_SIZE_Y % TILE_SIZE)
+#error TILE_SIZE must divide POND_SIZE_X and POND_SIZE_Y
+#endif
+
+// message types posted to a tile's mailbox
+#define MSG_KILL 0
+#define MSG_SHARE 1
+#define MSG_OFFSPRING 2
+
+// tile messages a worker allocates at once when it has none to reuse
+#define MESSAGE_BLOCK 256
+
+// RNG variables; indexes and arrays
+// RNG functions
+#define N 624
+#define M 397
+#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
+#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
+#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
+
+// one RNG per cell in cellArray order, so a tile's RNGs are contiguous like
+// its cells, then the inflow picker, then one cell picker per thread
+#define INFLOW_RNG (POND_SIZE_X * POND_SIZE_Y)
+#define PICKER_RNG(thread) (POND_SIZE_X * POND_SIZE_Y + 1 + (thread))
+
+static unsigned long (*rngArray)[N];
+static int *rngIndexArray;
+static int numRNGs;
+
+static void init_genrand(int whichRNG, unsigned long s)
+{
+	int j;
+	rngArray[whichRNG][0] = (s) & 0xffffffffUL;
+	for (j = 1; j < N; j++) {
+		rngArray[whichRNG][j] = (1812433253UL * (rngArray[whichRNG][j-1] ^ (rngArray[whichRNG][j-1] >> 30)) + j);
+		rngArray[whichRNG][j] &= 0xffffffffUL;
+	}
+	rngIndexArray[whichRNG] = N;
+}
+
+static inline uint32_t genrand_int32Array(int whichRNG) {
+	uint32_t y;
+	static const uint32_t mag01[2]={0x0UL, MATRIX_A};
+	unsigned long *mt = rngArray[whichRNG];
+
+	if (rngIndexArray[whichRNG] >= N) { /* generate N words at one time */
+		int kk;
+		for (kk=0;kk<N-M;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		for (;kk<N-1;kk++) {
+			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+			mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		}
+		y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
+		mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+
+		rngIndexArray[whichRNG] = 0;
+	}
+
+	y = mt[rngIndexArray[whichRNG]++];
+
+	/* Tempering */
+	y ^= (y >> 11);
+	y ^= (y << 7) & 0x9d2c5680UL;
+	y ^= (y << 15) & 0xefc60000UL;
+	y ^= (y >> 18);
+
+	return y;
+}
+
+static inline uintptr_t getRandomFromArray(int whichRNG)
+{
+	if (sizeof(uintptr_t) == 8)
+		return (uintptr_t)((((uint64_t)genrand_int32Array(whichRNG)) << 32) ^ ((uint64_t)genrand_int32Array(whichRNG)));
+	return (uintptr_t)genrand_int32Array(whichRNG);
+}
+
+//central structures
+static const uintptr_t BITS_IN_FOURBIT_WORD[16] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
+
+struct Cell {
+	uint64_t ID;            /* Globally unique cell ID */
+	uint64_t parentID;      /* ID of the cell's parent */
+	uint64_t lineage;       /* Equal to the cell ID of the first cell in the line. */
+	uintptr_t generation;       /* Generations start at 0 and are incremented from there. */
+	uintptr_t energy;       /* Energy level of this cell */
+	uintptr_t genome[MAX_WORDS_GENOME];/* four-bit instructions packed into machine-size words */
+};
+
+// NUM_TILES blocks of TILE_CELLS cells, each block in [x][y] order
+static struct Cell *cellArray;
+
+struct TileMessage {
+	struct TileMessage *next;
+	int sender;             /* worker that takes it back once applied */
+	uintptr_t type;
+	uintptr_t cellIndex;    /* index of the target cell in cellArray */
+	int64_t energyDelta;    /* MSG_SHARE: energy moved into the target cell */
+	uint64_t parentID;      /* MSG_OFFSPRING: stats and genome to write */
+	uint64_t lineage;
+	uintptr_t generation;
+	uintptr_t genome[MAX_WORDS_GENOME];
+};
+
+struct Tile {
+	_Atomic(struct TileMessage *) mailbox;	/* pushed by anyone, emptied by the owner */
+	int owner;
+} __attribute__((aligned(64)));
+
+static struct Tile tiles[NUM_TILES];
+
+struct PerUpdateStatCounters
+{
+	double instructionExecutions[16];/* Per-instruction-type execution count since last update. */
+	double cellExecutions;      /* Number of cells executed since last update */
+	uintptr_t viableCellsReplaced;  /* Number of viable cells replaced by other cells' offspring */
+	uintptr_t viableCellsKilled;    /* Number of viable cells KILLed */
+	uintptr_t viableCellShares; /* Number of successful SHARE operations */
+};
+
+struct Worker {
+	int firstTile;          /* owned tiles are [firstTile, firstTile + numTiles) */
+	int numTiles;
+	uintptr_t picks;        /* picks per batch, proportional to owned cells */
+	_Atomic int64_t pending;	/* messages posted to our tiles and not yet applied */
+	_Atomic(struct TileMessage *) returned;	/* our messages, applied and handed back */
+	struct TileMessage *freeMessages;	/* ours to reuse; only we touch it */
+	struct TileMessage **returnHead;	/* per sender, messages drainMailboxes() is handing back */
+	struct TileMessage **returnTail;
+	uintptr_t messagesSent;
+	uintptr_t messagesApplied;
+	uintptr_t messagesAllocated;
+	struct PerUpdateStatCounters stats;
+} __attribute__((aligned(64)));
+
+static struct Worker *workers;
+static int numWorkers;
+
+struct PerUpdateStatCounters statCounters;
+
+static inline uintptr_t cellIndex(const uintptr_t x, const uintptr_t y)
+{
+	return ((x / TILE_SIZE) * TILES_Y + (y / TILE_SIZE)) * TILE_CELLS
+		+ (x % TILE_SIZE) * TILE_SIZE + (y % TILE_SIZE);
+}
+
+static inline int tileOf(const uintptr_t index)
+{
+	return (int)(index / TILE_CELLS);
+}
+
+static void doUpdate(const uintptr_t clock)
+{
+	static uint64_t lastTotalViableReplicators = 0;
+
+	uintptr_t x,y;
+	int w;
+
+	uint64_t totalActiveCells = 0;
+	uint64_t totalEnergy = 0;
+	uint64_t totalViableReplicators = 0;
+	uintptr_t maxGeneration = 0;
+	uintptr_t messages = 0, allocated = 0;
+
+	for(x=0;x<POND_SIZE_X;++x) {
+		for(y=0;y<POND_SIZE_Y;++y) {
+			struct Cell *const c = &cellArray[cellIndex(x,y)];
+			if (c->energy) {
+				++totalActiveCells;
+				totalEnergy += (uint64_t)c->energy;
+				if (c->generation > 2)
+					++totalViableReplicators;
+				if (c->generation > maxGeneration)
+					maxGeneration = c->generation;
+			}
+		}
+	}
+
+	/* Fold per-thread counters into the global ones */
+	for (w = 0; w < numWorkers; w++) {
+		struct PerUpdateStatCounters *s = &workers[w].stats;
+		for(x=0;x<16;++x)
+			statCounters.instructionExecutions[x] += s->instructionExecutions[x];
+		statCounters.cellExecutions += s->cellExecutions;
+		statCounters.viableCellsReplaced += s->viableCellsReplaced;
+		statCounters.viableCellsKilled += s->viableCellsKilled;
+		statCounters.viableCellShares += s->viableCellShares;
+		messages += workers[w].messagesSent;
+		allocated += workers[w].messagesAllocated;
+		memset(s,0,sizeof(*s));
+		workers[w].messagesSent = 0;
+	}
+
+	/* Look here to get the columns in the CSV output */
+	/* The first five are here and are self-explanatory */
+	printf("%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+		(uint64_t)clock,
+		(uint64_t)totalEnergy,
+		(uint64_t)totalActiveCells,
+		(uint64_t)totalViableReplicators,
+		(uint64_t)maxGeneration,
+		(uint64_t)statCounters.viableCellsReplaced,
+		(uint64_t)statCounters.viableCellsKilled,
+		(uint64_t)statCounters.viableCellShares
+	);
+
+	/* The next 16 are the average frequencies of execution for each instruction per cell execution. */
+	double totalMetabolism = 0.0;
+	for(x=0;x<16;++x) {
+		totalMetabolism += statCounters.instructionExecutions[x];
+		printf(",%.4f",
+			(statCounters.cellExecutions > 0.0)
+			? (statCounters.instructionExecutions[x] / statCounters.cellExecutions)
+			: 0.0);
+	}
+
+	/* The last column is the average metabolism per cell execution */
+	printf(",%.4f\n",
+			(statCounters.cellExecutions > 0.0)
+			? (totalMetabolism / statCounters.cellExecutions)
+			: 0.0);
+	fflush(stdout);
+
+	fprintf(stderr,"[INFO] %lu cross-tile messages since last update, %lu allocated in all\n",messages,allocated);
+
+	if ((lastTotalViableReplicators > 0)&&(totalViableReplicators == 0))
+		fprintf(stderr,
+			"[EVENT] Viable replicators have gone extinct. "\
+			"Please reserve a moment of silence.\n");
+	else
+		if ((lastTotalViableReplicators == 0)&&(totalViableReplicators > 0))
+			fprintf(stderr,"[EVENT] Viable replicators have appeared!\n");
+
+	lastTotalViableReplicators = totalViableReplicators;
+
+	/* Reset per-update stat counters */
+	memset(&statCounters,0,sizeof(statCounters));
+}
+
+static void doReport(const uintptr_t clock)
+{
+	char buf[MAX_NUM_INSTR*2];
+	FILE *d;
+	uintptr_t x,y,wordPtr,shiftPtr,inst,stopCount,i;
+	struct Cell *currCell;
+
+	sprintf(buf,"p%lu.report.csv",clock);
+	d = fopen(buf,"w");
+	if (!d) {
+		fprintf(stderr,"[WARNING] Could not open %s for writing.\n",buf);
+		return;
+	}
+
+	fprintf(stderr,"[INFO] Reporting viable cells to %s\n",buf);
+
+	for(x=0;x<POND_SIZE_X;++x) {
+		for(y=0;y<POND_SIZE_Y;++y) {
+			currCell = &cellArray[cellIndex(x,y)];
+			if (currCell->energy&&(currCell->generation > 2)) {
+				fprintf(d,"ID: %lu, parent ID: %lu, lineage: %lu, generation: %lu\n",
+					(uint64_t)currCell->ID,
+					(uint64_t)currCell->parentID,
+					(uint64_t)currCell->lineage,
+					(uint64_t)currCell->generation);
+				wordPtr = 0;
+				shiftPtr = 0;
+				stopCount = 0;
+				for(i=0;i<MAX_NUM_INSTR;++i) {
+					inst = (currCell->genome[wordPtr] >> shiftPtr) & 0xf;
+					/* Four STOP instructions in a row is considered the end. */
+					fprintf(d,"%lx",inst);
+					if (inst == 0xf) { /* STOP */
+						if (++stopCount >= 4)
+							break;
+					} else
+						stopCount = 0;
+
+					if ((shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++wordPtr >= MAX_WORDS_GENOME) {
+							wordPtr = 0;
+							shiftPtr = 4;
+						} else
+							shiftPtr = 0;
+					}
+				}
+			}
+		}
+	}
+	fclose(d);
+}
+
+/**
+ * Get the index of a neighbor in the cellArray
+ */
+static inline uintptr_t getNeighbor(const uintptr_t x,const uintptr_t y,const uintptr_t dir)
+{
+	/* Space is toroidal; it wraps at edges */
+	switch(dir) {
+		case N_LEFT: 	return (x) ? cellIndex(x-1,y) : cellIndex(POND_SIZE_X-1,y);
+		case N_RIGHT: 	return (x < (POND_SIZE_X-1)) ? cellIndex(x+1,y) : cellIndex(0,y);
+		case N_UP: 	return (y) ? cellIndex(x,y-1) : cellIndex(x,POND_SIZE_Y-1);
+		case N_DOWN: 	return (y < (POND_SIZE_Y-1)) ? cellIndex(x,y+1) : cellIndex(x,0);
+	}
+	return cellIndex(x,y); /* This should never be reached */
+}
+
+/**
+ * Determines if c1 is allowed to access c2
+ */
+static inline int accessAllowed(struct Cell *const c2,const uintptr_t c1guess,int sense, int currRNG)
+{
+	/* Access permission is more probable if they are more similar in sense 0,
+	* and more probable if they are different in sense 1. Sense 0 is used for
+	* "negative" interactions and sense 1 for "positive" ones. */
+	return sense
+		? (((getRandomFromArray(currRNG) & 0xf) >=
+			BITS_IN_FOURBIT_WORD[(c2->genome[0] & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID))
+		: (((getRandomFromArray(currRNG) & 0xf) <=
+			BITS_IN_FOURBIT_WORD[(c2->genome[0] & 0xf) ^ (c1guess & 0xf)])||(!c2->parentID));
+}
+
+/**
+ * Pushes a message onto a tile's mailbox. Safe to call from any thread.
+ */
+static void postMessage(struct Worker *self, struct TileMessage *msg)
+{
+	struct Tile *t = &tiles[tileOf(msg->cellIndex)];
+	struct TileMessage *head = atomic_load_explicit(&t->mailbox,memory_order_relaxed);
+
+	do {
+		msg->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(&t->mailbox,&head,msg,
+			memory_order_release,memory_order_relaxed));
+	atomic_fetch_add_explicit(&workers[t->owner].pending,1,memory_order_release);
+	++self->messagesSent;
+}
+
+/**
+ * Takes back the messages other workers have applied, or allocates
+ * MESSAGE_BLOCK more if none have come back, and returns them as a list.
+ */
+static struct TileMessage *refillMessages(struct Worker *self)
+{
+	struct TileMessage *list = atomic_exchange_explicit(&self->returned,NULL,memory_order_acquire);
+	int i;
+
+	if (list)
+		return list;
+	list = malloc(MESSAGE_BLOCK * sizeof(struct TileMessage));
+	if (!list) {
+		fprintf(stderr,"[ERROR] Out of memory for tile messages\n");
+		exit(1);
+	}
+	for (i = 0; i < MESSAGE_BLOCK - 1; i++)
+		list[i].next = &list[i + 1];
+	list[MESSAGE_BLOCK - 1].next = NULL;
+	self->messagesAllocated += MESSAGE_BLOCK;
+	return list;
+}
+
+static struct TileMessage *newMessage(struct Worker *self, const uintptr_t type, const uintptr_t index)
+{
+	struct TileMessage *msg = self->freeMessages;
+	if (!msg)
+		msg = refillMessages(self);
+	self->freeMessages = msg->next;
+	msg->sender = (int)(self - workers);
+	msg->type = type;
+	msg->cellIndex = index;
+	return msg;
+}
+
+/**
+ * Pushes a list of applied messages, first to last, back onto their
+ * sender's returned stack. Safe to call from any thread.
+ */
+static void returnMessages(struct Worker *sender, struct TileMessage *first, struct TileMessage *last)
+{
+	struct TileMessage *head = atomic_load_explicit(&sender->returned,memory_order_relaxed);
+
+	do {
+		last->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(&sender->returned,&head,first,
+			memory_order_release,memory_order_relaxed));
+}
+
+static void applyMessage(const struct TileMessage *msg)
+{
+	struct Cell *c = &cellArray[msg->cellIndex];
+	uintptr_t i;
+
+	switch(msg->type) {
+		case MSG_KILL:
+			c->genome[0] = ~((uintptr_t)0);
+			c->genome[1] = ~((uintptr_t)0);
+			c->parentID = 0;
+			c->generation = 0;
+			break;
+		case MSG_SHARE:
+			// The owner may have spent some of this energy since the
+			// sender read it, so a negative delta is clamped at zero.
+			if ((msg->energyDelta < 0)&&((uintptr_t)(-msg->energyDelta) > c->energy))
+				c->energy = 0;
+			else c->energy += msg->energyDelta;
+			break;
+		case MSG_OFFSPRING:
+			c->parentID = msg->parentID;
+			c->lineage = msg->lineage;
+			c->generation = msg->generation;
+			for(i=0;i<MAX_WORDS_GENOME;++i)
+				c->genome[i] = msg->genome[i];
+			break;
+	}
+}
+
+/**
+ * Applies everything waiting in the mailboxes of the tiles we own, then
+ * hands the messages back to their senders, one push per sender.
+ */
+static void drainMailboxes(struct Worker *self)
+{
+	struct TileMessage *list, *reversed, *next;
+	int64_t applied = 0;
+	int t, w;
+
+	if (atomic_load_explicit(&self->pending,memory_order_acquire) <= 0)
+		return;
+
+	for (t = self->firstTile; t < self->firstTile + self->numTiles; t++) {
+		if (!atomic_load_explicit(&tiles[t].mailbox,memory_order_relaxed))
+			continue;
+		list = atomic_exchange_explicit(&tiles[t].mailbox,NULL,memory_order_acquire);
+
+		/* The mailbox is a stack; reverse it to apply in posting order */
+		reversed = NULL;
+		for (; list; list = next) {
+			next = list->next;
+			list->next = reversed;
+			reversed = list;
+		}
+		for (; reversed; reversed = next) {
+			next = reversed->next;
+			applyMessage(reversed);
+			reversed->next = self->returnHead[reversed->sender];
+			if (!self->returnHead[reversed->sender])
+				self->returnTail[reversed->sender] = reversed;
+			self->returnHead[reversed->sender] = reversed;
+			++applied;
+		}
+	}
+	for (w = 0; w < numWorkers; w++) {
+		if (!self->returnHead[w])
+			continue;
+		if (&workers[w] == self) {
+			self->returnTail[w]->next = self->freeMessages;
+			self->freeMessages = self->returnHead[w];
+		} else returnMessages(&workers[w],self->returnHead[w],self->returnTail[w]);
+		self->returnHead[w] = NULL;
+	}
+	atomic_fetch_sub_explicit(&self->pending,applied,memory_order_relaxed);
+	self->messagesApplied += applied;
+}
+
+static void executeCell(struct Worker *self, const uintptr_t x, const uintptr_t y) {
+	struct Cell *currCell = &cellArray[cellIndex(x,y)];
+	if (!currCell->energy)
+		return;
+
+	uintptr_t ptr_wordPtr = 0;
+	uintptr_t ptr_shiftPtr = 0;
+	uintptr_t reg = 0;
+	uintptr_t loopStack_wordPtr[MAX_NUM_INSTR];
+	uintptr_t loopStack_shiftPtr[MAX_NUM_INSTR];
+	uintptr_t loopStackPtr = 0;
+	uintptr_t wordPtr = EXEC_START_WORD;
+	uintptr_t shiftPtr = EXEC_START_BIT;
+	uintptr_t facing = 0;
+	uintptr_t falseLoopDepth = 0;
+	int stop = 0;
+	uintptr_t currentWord;
+	uintptr_t inst, tmp;
+	uintptr_t neighbor;
+	struct Cell *neighborCell;
+	struct TileMessage *msg;
+	struct PerUpdateStatCounters *stats = &self->stats;
+	const int me = (int)(self - workers);
+
+	int currRNG = (int)(currCell - cellArray);
+	currentWord = currCell->genome[0];
+
+	uintptr_t i;
+	uintptr_t outputBuf[MAX_WORDS_GENOME];
+	for(i=0;i<MAX_WORDS_GENOME;++i)
+		outputBuf[i] = ~((uintptr_t)0);
+
+	stats->cellExecutions += 1.0;
+
+	while (currCell->energy&&(!stop)) {
+		inst = (currentWord >> shiftPtr) & 0xf;
+		stats->instructionExecutions[inst] += 1.0;
+
+		if ((getRandomFromArray(currRNG) & 0xffffffff) < MUTATION_RATE) {
+			tmp = getRandomFromArray(currRNG);
+			if (tmp & 0x80) // Check for the 8th bit to get random boolean //
+				inst = tmp & 0xf; // Only the first four bits are used here //
+			else reg = tmp & 0xf;
+		}
+
+		--currCell->energy;
+
+		if (falseLoopDepth) {
+			if (inst == 0x9)
+				++falseLoopDepth;
+			else if (inst == 0xa)
+				--falseLoopDepth;
+		} else {
+			switch(inst) {
+				case 0x0: // ZERO: Zero VM state registers //
+					reg = 0;
+					ptr_wordPtr = 0;
+					ptr_shiftPtr = 0;
+					facing = 0;
+					break;
+				case 0x1: // FWD: Increment the pointer (wrap at end) //
+					if ((ptr_shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++ptr_wordPtr >= MAX_WORDS_GENOME)
+							ptr_wordPtr = 0;
+						ptr_shiftPtr = 0;
+					}
+					break;
+				case 0x2: // BACK: Decrement the pointer (wrap at beginning) //
+					if (ptr_shiftPtr)
+						ptr_shiftPtr -= 4;
+					else {
+						if (ptr_wordPtr)
+							--ptr_wordPtr;
+						else ptr_wordPtr = MAX_WORDS_GENOME - 1;
+						ptr_shiftPtr = BITS_IN_WORD - 4;
+					}
+					break;
+				case 0x3: // INC: Increment the register //
+					reg = (reg + 1) & 0xf;
+					break;
+				case 0x4: // DEC: Decrement the register //
+					reg = (reg - 1) & 0xf;
+					break;
+				case 0x5: // READG: Read into the register from genome //
+					reg = (currCell->genome[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x6: // WRITEG: Write out from the register to genome //
+					currCell->genome[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					currCell->genome[ptr_wordPtr] |= reg << ptr_shiftPtr;
+					currentWord = currCell->genome[wordPtr]; // Must refresh in case this changed! //
+					break;
+				case 0x7: // READB: Read into the register from buffer //
+					reg = (outputBuf[ptr_wordPtr] >> ptr_shiftPtr) & 0xf;
+					break;
+				case 0x8: // WRITEB: Write out from the register to buffer //
+					outputBuf[ptr_wordPtr] &= ~(((uintptr_t)0xf) << ptr_shiftPtr);
+					outputBuf[ptr_wordPtr] |= reg << ptr_shiftPtr;
+					break;
+				case 0x9: // LOOP: Jump forward to matching REP if register is zero //
+					if (reg) {
+						if (loopStackPtr >= MAX_NUM_INSTR)
+							stop = 1; // Stack overflow ends execution //
+						else {
+							loopStack_wordPtr[loopStackPtr] = wordPtr;
+							loopStack_shiftPtr[loopStackPtr] = shiftPtr;
+							++loopStackPtr;
+						}
+					} else falseLoopDepth = 1;
+					break;
+				case 0xa: // REP: Jump back to matching LOOP if register is nonzero //
+					if (loopStackPtr) {
+						--loopStackPtr;
+						if (reg) {
+							wordPtr = loopStack_wordPtr[loopStackPtr];
+							shiftPtr = loopStack_shiftPtr[loopStackPtr];
+							currentWord = currCell->genome[wordPtr];
+							// This ensures that the LOOP is rerun //
+							continue;
+						}
+					}
+					break;
+				case 0xb: // TURN: Turn in the direction specified by register //
+					facing = reg & 3;
+					break;
+				case 0xc: // XCHG: Skip next instruction and exchange value of register with it //
+					if ((shiftPtr += 4) >= BITS_IN_WORD) {
+						if (++wordPtr >= MAX_WORDS_GENOME) {
+							wordPtr = EXEC_START_WORD;
+							shiftPtr = EXEC_START_BIT;
+						} else shiftPtr = 0;
+					}
+					tmp = reg;
+					reg = (currCell->genome[wordPtr] >> shiftPtr) & 0xf;
+					currCell->genome[wordPtr] &= ~(((uintptr_t)0xf) << shiftPtr);
+					currCell->genome[wordPtr] |= tmp << shiftPtr;
+					currentWord = currCell->genome[wordPtr];
+					break;
+				case 0xd: // KILL: Blow away neighboring cell if allowed with penalty on failure //
+					neighbor = getNeighbor(x,y,facing);
+					neighborCell = &cellArray[neighbor];
+					if (accessAllowed(neighborCell,reg,0,currRNG)) {
+						if (neighborCell->generation > 2)
+							++stats->viableCellsKilled;
+
+						if (tiles[tileOf(neighbor)].owner == me) {
+							// Filling first two words with 0xfffff... is enough //
+							neighborCell->genome[0] = ~((uintptr_t)0);
+							neighborCell->genome[1] = ~((uintptr_t)0);
+							neighborCell->parentID = 0;
+							neighborCell->generation = 0;
+						} else postMessage(self,newMessage(self,MSG_KILL,neighbor));
+					} else if (neighborCell->generation > 2) {
+						tmp = currCell->energy / FAILED_KILL_PENALTY;
+						if (currCell->energy > tmp)
+							currCell->energy -= tmp;
+						else currCell->energy = 0;
+					}
+					break;
+				case 0xe: // SHARE: Equalize energy between self and neighbor if allowed //
+					neighbor = getNeighbor(x,y,facing);
+					neighborCell = &cellArray[neighbor];
+					if (accessAllowed(neighborCell,reg,1,currRNG)) {
+						uintptr_t neighborEnergy = neighborCell->energy;
+
+						if (neighborCell->generation > 2)
+							++stats->viableCellShares;
+
+						tmp = currCell->energy + neighborEnergy;
+						if (tiles[tileOf(neighbor)].owner == me)
+							neighborCell->energy = tmp / 2;
+						else {
+							msg = newMessage(self,MSG_SHARE,neighbor);
+							msg->energyDelta = (int64_t)(tmp / 2) - (int64_t)neighborEnergy;
+							postMessage(self,msg);
+						}
+						currCell->energy = tmp - tmp / 2;
+					}
+					break;
+				case 0xf: // STOP: End execution //
+					stop = 1;
+					break;
+			} // end switch
+		} // end else for falseLoopDepth
+
+		if ((shiftPtr += 4) >= BITS_IN_WORD) {
+			if (++wordPtr >= MAX_WORDS_GENOME) {
+				wordPtr = EXEC_START_WORD;
+				shiftPtr = EXEC_START_BIT;
+			} else shiftPtr = 0;
+			currentWord = currCell->genome[wordPtr];
+		} // end if
+	} // end while
+
+	if ((outputBuf[0] & 0xff) != 0xff) {
+		neighbor = getNeighbor(x,y,facing);
+		neighborCell = &cellArray[neighbor];
+		if ((neighborCell->energy)&&accessAllowed(neighborCell,reg,0,currRNG)) {
+			if (neighborCell->generation > 2)
+				++stats->viableCellsReplaced;
+
+			if (tiles[tileOf(neighbor)].owner == me) {
+				neighborCell->parentID = currCell->ID;
+				neighborCell->lineage = currCell->lineage;
+				neighborCell->generation = currCell->generation + 1;
+				for(i=0;i<MAX_WORDS_GENOME;++i)
+					neighborCell->genome[i] = outputBuf[i];
+			} else {
+				msg = newMessage(self,MSG_OFFSPRING,neighbor);
+				msg->parentID = currCell->ID;
+				msg->lineage = currCell->lineage;
+				msg->generation = currCell->generation + 1;
+				for(i=0;i<MAX_WORDS_GENOME;++i)
+					msg->genome[i] = outputBuf[i];
+				postMessage(self,msg);
+			}
+		}
+	}
+}
+
+/**
+ * Picks a random cell in our own tiles and executes it.
+ */
+static void pickAndExecute(struct Worker *self, const int pickerRNG)
+{
+	const uintptr_t r = getRandomFromArray(pickerRNG);
+	const int t = self->firstTile + (int)(r % (uintptr_t)self->numTiles);
+	const uintptr_t inTile = (r >> 32) % TILE_CELLS;
+	const uintptr_t x = (uintptr_t)(t / TILES_Y) * TILE_SIZE + inTile / TILE_SIZE;
+	const uintptr_t y = (uintptr_t)(t % TILES_Y) * TILE_SIZE + inTile % TILE_SIZE;
+
+	drainMailboxes(self);
+	executeCell(self,x,y);
+}
+
+/**
+ * Splits the tiles into contiguous ranges, one per thread. Tiles are
+ * numbered column-major, so each thread gets a band of whole tile columns
+ * where possible and neighboring threads share only the band edges.
+ */
+static void assignTiles()
+{
+	int w, t;
+	uintptr_t given = 0;
+
+	for (w = 0; w < numWorkers; w++) {
+		workers[w].firstTile = w * NUM_TILES / numWorkers;
+		workers[w].numTiles = (w + 1) * NUM_TILES / numWorkers - workers[w].firstTile;
+		workers[w].picks = (uintptr_t)BATCH_SIZE * workers[w].numTiles / NUM_TILES;
+		given += workers[w].picks;
+		atomic_init(&workers[w].pending,0);
+		atomic_init(&workers[w].returned,NULL);
+		for (t = workers[w].firstTile; t < workers[w].firstTile + workers[w].numTiles; t++) {
+			tiles[t].owner = w;
+			atomic_init(&tiles[t].mailbox,NULL);
+		}
+	}
+	workers[numWorkers - 1].picks += BATCH_SIZE - given;
+}
+
+/**
+ * Allocates one of the big pond arrays without touching it, so that its
+ * pages are placed by whichever thread writes them first.
+ */
+static void *allocPond(const size_t bytes, const char *what)
+{
+#ifdef USE_NUMA
+	void *p = mmap(NULL,bytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if (p == MAP_FAILED)
+		p = NULL;
+#ifdef NUMA_INTERLEAVE
+	if (p && (numa_available() >= 0)) {
+		struct bitmask *nodes = numa_get_mems_allowed();
+		if (mbind(p,bytes,MPOL_INTERLEAVE,nodes->maskp,nodes->size + 1,0))
+			fprintf(stderr,"[WARNING] mbind(MPOL_INTERLEAVE) failed for %s, using first touch\n",what);
+		numa_bitmask_free(nodes);
+	}
+#endif /* NUMA_INTERLEAVE */
+#else
+	void *p = aligned_alloc(64,(bytes + 63) & ~(size_t)63);
+#endif /* USE_NUMA */
+	if (!p) {
+		fprintf(stderr,"[ERROR] Could not allocate %zu bytes for %s\n",bytes,what);
+		exit(1);
+	}
+	return p;
+}
+
+#ifdef USE_NUMA
+static int *workerCPU;
+
+/**
+ * Pins worker w to a CPU. CPUs are ordered node by node, and workers own
+ * tile bands in order, so workers with adjacent bands sit on the same node
+ * and only the band edges cross a socket.
+ */
+static void mapWorkersToCPUs()
+{
+	int numCPUs = numa_num_configured_cpus();
+	int *cpus = malloc(numCPUs * sizeof(int));
+	int node, cpu, count = 0, w;
+	struct bitmask *allowed = numa_allocate_cpumask();
+
+	workerCPU = malloc(numWorkers * sizeof(int));
+	if (!cpus || !workerCPU) {
+		fprintf(stderr,"[ERROR] Could not allocate the CPU map\n");
+		exit(1);
+	}
+	sched_getaffinity(0,numa_bitmask_nbytes(allowed),(cpu_set_t *)allowed->maskp);
+	for (node = 0; node <= numa_max_node(); node++) {
+		for (cpu = 0; cpu < numCPUs; cpu++) {
+			if (numa_bitmask_isbitset(allowed,cpu) && (numa_node_of_cpu(cpu) == node))
+				cpus[count++] = cpu;
+		}
+	}
+	numa_free_cpumask(allowed);
+
+	// With more workers than CPUs, neighboring workers share a CPU
+	for (w = 0; w < numWorkers; w++)
+		workerCPU[w] = count ? cpus[(uintptr_t)w * count / numWorkers] : -1;
+	free(cpus);
+}
+
+static void pinWorker(const int w)
+{
+	cpu_set_t set;
+
+	if (workerCPU[w] < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(workerCPU[w],&set);
+	if (pthread_setaffinity_np(pthread_self(),sizeof(set),&set))
+		fprintf(stderr,"[WARNING] Could not pin worker %d to CPU %d\n",w,workerCPU[w]);
+}
+
+/**
+ * Prints how many pages of an array ended up on each node, sampling at
+ * most 4096 pages.
+ */
+static void reportPlacement(const char *what, void *base, const size_t bytes)
+{
+	const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t pages = (bytes + pageSize - 1) / pageSize;
+	const size_t step = (pages > 4096) ? pages / 4096 : 1;
+	const size_t samples = (pages + step - 1) / step;
+	void **addrs = malloc(samples * sizeof(void *));
+	int *status = malloc(samples * sizeof(int));
+	int maxNode = numa_max_node(), node;
+	size_t *perNode = calloc(maxNode + 2,sizeof(size_t));
+	size_t i;
+
+	if (!addrs || !status || !perNode)
+		return;
+	for (i = 0; i < samples; i++)
+		addrs[i] = (char *)base + i * step * pageSize;
+	if (move_pages(0,samples,addrs,NULL,status,0)) {
+		fprintf(stderr,"[WARNING] move_pages() could not locate %s\n",what);
+	} else {
+		for (i = 0; i < samples; i++)
+			++perNode[((status[i] >= 0)&&(status[i] <= maxNode)) ? status[i] : maxNode + 1];
+		fprintf(stderr,"[INFO] %s (%zu MB):",what,bytes >> 20);
+		for (node = 0; node <= maxNode; node++)
+			fprintf(stderr," node%d %.1f%%",node,100.0 * perNode[node] / samples);
+		if (perNode[maxNode + 1])
+			fprintf(stderr," unplaced %.1f%%",100.0 * perNode[maxNode + 1] / samples);
+		fprintf(stderr,"\n");
+	}
+	free(addrs);
+	free(status);
+	free(perNode);
+}
+#endif /* USE_NUMA */
+
+/**
+ * Sizes and allocates the pond. Nothing is written to the cells or their
+ * RNGs here; each worker clears its own tiles in initializeTiles().
+ */
+static void initializePond() {
+	numWorkers = omp_get_max_threads();
+	if (numWorkers > NUM_TILES)
+		numWorkers = NUM_TILES;
+
+	workers = aligned_alloc(64,numWorkers * sizeof(struct Worker));
+	if (!workers) {
+		fprintf(stderr,"[ERROR] Could not allocate the workers\n");
+		exit(1);
+	}
+	memset(workers,0,numWorkers * sizeof(struct Worker));
+	assignTiles();
+
+	numRNGs = POND_SIZE_X * POND_SIZE_Y + 1 + numWorkers;
+	cellArray = allocPond((size_t)NUM_TILES * TILE_CELLS * sizeof(struct Cell),"cellArray");
+	rngArray = allocPond((size_t)numRNGs * sizeof(*rngArray),"rngArray");
+	rngIndexArray = allocPond((size_t)numRNGs * sizeof(int),"rngIndexArray");
+
+#ifdef USE_NUMA
+	if (numa_available() < 0) {
+		fprintf(stderr,"[ERROR] USE_NUMA is set but this kernel has no NUMA support\n");
+		exit(1);
+	}
+	mapWorkersToCPUs();
+#endif /* USE_NUMA */
+	fprintf(stderr,"[INFO] %d threads, %d tiles of %dx%d cells\n",numWorkers,NUM_TILES,TILE_SIZE,TILE_SIZE);
+}
+
+/**
+ * Clears the cells of our own tiles, seeds their RNGs and allocates our
+ * first block of tile messages. Run by every worker, so each page is first
+ * touched by the thread that will use it.
+ */
+static void initializeTiles(struct Worker *self)
+{
+	const uintptr_t first = (uintptr_t)self->firstTile * TILE_CELLS;
+	const uintptr_t last = first + (uintptr_t)self->numTiles * TILE_CELLS;
+	uintptr_t i, j;
+
+	for(i=first;i<last;++i) {
+		cellArray[i].ID = 0;
+		cellArray[i].parentID = 0;
+		cellArray[i].lineage = 0;
+		cellArray[i].generation = 0;
+		cellArray[i].energy = 0;
+		for(j=0;j<MAX_WORDS_GENOME;++j)
+			cellArray[i].genome[j] = ~((uintptr_t)0);
+		// Cell RNGs all share one seed as in parallelEdit.c
+		init_genrand((int)i,1234567890);
+	}
+
+	self->returnHead = calloc(2 * numWorkers,sizeof(struct TileMessage *));
+	if (!self->returnHead) {
+		fprintf(stderr,"[ERROR] Out of memory for tile messages\n");
+		exit(1);
+	}
+	self->returnTail = self->returnHead + numWorkers;
+	self->freeMessages = refillMessages(self);
+}
+
+/**
+ * Seeds the inflow and picker RNGs. The pickers get their own seeds or
+ * every thread would pick the same offsets in its tiles.
+ */
+static void initializePickers()
+{
+	int i, j;
+
+	for(i=INFLOW_RNG;i<numRNGs;++i) {
+		init_genrand(i,1234567890 + (i - INFLOW_RNG));
+		for(j=0;j<1024;++j)
+			getRandomFromArray(i);
+	}
+#ifdef USE_NUMA
+	for (i = 0; i < numWorkers; i++)
+		fprintf(stderr,"[INFO] worker %d: tiles %d-%d, CPU %d, node %d\n",i,
+			workers[i].firstTile,workers[i].firstTile + workers[i].numTiles - 1,
+			workerCPU[i],(workerCPU[i] >= 0) ? numa_node_of_cpu(workerCPU[i]) : -1);
+	reportPlacement("cellArray",cellArray,(size_t)NUM_TILES * TILE_CELLS * sizeof(struct Cell));
+	reportPlacement("rngArray",rngArray,(size_t)numRNGs * sizeof(*rngArray));
+#endif /* USE_NUMA */
+}
+
+//main
+int main()  {
+	struct timeval runStart, runStop;
+	gettimeofday(&runStart, NULL);
+
+	uintptr_t clock = 0;
+	uint64_t cellIDCounter = 0;
+
+	// Allocates the pond; workers clear their own tiles below
+	initializePond();
+
+#pragma omp parallel num_threads(numWorkers)
+{
+	struct Worker *self = &workers[omp_get_thread_num()];
+	const int pickerRNG = PICKER_RNG(omp_get_thread_num());
+	uintptr_t i, j;
+	int done = 0;
+
+#ifdef USE_NUMA
+	pinWorker(omp_get_thread_num());
+#endif
+	initializeTiles(self);
+	#pragma omp barrier
+	#pragma omp master
+	initializePickers();
+	#pragma omp barrier
+
+	while (!done) {
+		for (i = 0; i < self->picks; i++)
+			pickAndExecute(self,pickerRNG);
+
+		// Nothing is posted while mailboxes drain, so after this
+		// second barrier every message of the batch has been applied.
+		#pragma omp barrier
+		drainMailboxes(self);
+		#pragma omp barrier
+
+		#pragma omp master
+		{
+			clock += BATCH_SIZE;
+
+			// Introduce random cell with energy. Do this as many times as needed relative to batch size.
+			for (i = 0; i < BATCH_SIZE / INFLOW_FREQUENCY; i++) {
+				uintptr_t x = getRandomFromArray(INFLOW_RNG) % POND_SIZE_X;
+				uintptr_t y = getRandomFromArray(INFLOW_RNG) % POND_SIZE_Y;
+				struct Cell *currCell = &cellArray[cellIndex(x,y)];
+				currCell->ID = cellIDCounter;
+				currCell->parentID = 0;
+				currCell->lineage = cellIDCounter;
+				currCell->generation = 0;
+#ifdef INFLOW_RATE_VARIATION
+				currCell->energy += INFLOW_RATE_BASE + (getRandomFromArray(INFLOW_RNG) % INFLOW_RATE_VARIATION);
+#else
+				currCell->energy += INFLOW_RATE_BASE;
+#endif
+				for(j=0;j<MAX_WORDS_GENOME;++j)
+					currCell->genome[j] = getRandomFromArray(INFLOW_RNG);
+				++cellIDCounter;
+			}
+
+			if (!(clock % UPDATE_FREQUENCY))
+				doUpdate(clock);
+			if (!(clock % REPORT_FREQUENCY))
+				doReport(clock);
+		}
+		#pragma omp barrier
+
+#ifdef STOP_AT
+		done = (clock >= STOP_AT);
+#endif
+	}
+}
+
+	gettimeofday(&runStop, NULL);
+	printf("threads: %d difference: %lf \n", numWorkers, (runStop.tv_sec - runStart.tv_sec) + (runStop.tv_usec - runStart.tv_usec)/1000000.0);
+	exit(0);
+}